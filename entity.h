@@ -23,11 +23,21 @@
 #include <array>
 #include <vector>
 #include <unordered_map>
-#include <unordered_set>
 #include <memory>
+#include <new>
 #include <algorithm>
+#include <type_traits>
+#include <iterator>
 #include <functional>
+#include <tuple>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 
 // By default entities are 32 bit (16 bit index, 16 bit version number).
 // Define TWO_ENTITY_64 to use 64 bit entities.
@@ -48,12 +58,14 @@
 #define TWO_COMPONENT_INT_TYPE uint8_t
 #endif
 
-// Defines the maximum number of entities that may be alive at the same time
+// Defines the maximum number of entities that may be alive at the same time.
+// Storage for entities grows as needed so by default this is only limited
+// by the number of bits used for the entity index.
 #ifndef TWO_ENTITY_MAX
-#define TWO_ENTITY_MAX 8192
+#define TWO_ENTITY_MAX TWO_ENTITY_INDEX_MASK
 #endif
 
-// Defines the maximum number of component types
+// Defines the maximum number of component types used in the program
 #ifndef TWO_COMPONENT_MAX
 #define TWO_COMPONENT_MAX 64
 #endif
@@ -68,6 +80,16 @@
 #define TWO_COMPONENT_ARRAY_ALLOCATOR std::allocator
 #endif
 
+// Alignment of the field arrays of components stored as a structure of
+// arrays, see `SoaLayout`.
+#ifndef TWO_SOA_ALIGNMENT
+#define TWO_SOA_ALIGNMENT 64
+#endif
+
+// By default each component type is stored in its own `ComponentArray`.
+// Define TWO_STORAGE_ARCHETYPE to store components in archetype tables
+// instead, where all entities with the same entity mask share a table.
+
 // Enable assertions. ASSERT and ASSERTS can be defined before including
 // to use your own assertions.
 #ifdef TWO_ASSERTIONS
@@ -160,6 +182,93 @@ using ComponentType = TWO_COMPONENT_INT_TYPE;
 static_assert(std::is_integral<ComponentType>(),
               "ComponentType must be integral");
 
+namespace internal {
+
+// Returns the next unused component index. Indices are shared by all
+// worlds, so TWO_COMPONENT_MAX limits the number of component types used
+// in the whole program.
+inline ComponentType next_component_index() {
+    static std::atomic<size_t> next{0};
+    auto index = next++;
+    ASSERTS(index < TWO_COMPONENT_MAX, "Too many component types");
+    return ComponentType(index);
+}
+
+// Index of type `T` in the parameter pack `Ts`.
+template <typename T, typename... Ts>
+struct IndexOf;
+
+template <typename T, typename... Ts>
+struct IndexOf<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+
+template <typename T, typename U, typename... Ts>
+struct IndexOf<T, U, Ts...>
+    : std::integral_constant<size_t, 1 + IndexOf<T, Ts...>::value> {};
+
+// True if `Func` can be called with arguments of type `Args`.
+template <typename Func, typename... Args>
+struct IsCallable {
+private:
+    template <typename F>
+    static auto test(int) -> decltype(
+        std::declval<F>()(std::declval<Args>()...), std::true_type());
+
+    template <typename>
+    static std::false_type test(...);
+
+public:
+    static constexpr bool value = decltype(test<Func>(0))::value;
+};
+
+// Returns a `T` constructed with `T(args...)` if possible, otherwise with
+// `T{args...}` so aggregates can be constructed from their members.
+template <typename T, typename... Args>
+inline T construct(std::true_type, Args &&...args) {
+    return T(std::forward<Args>(args)...);
+}
+
+template <typename T, typename... Args>
+inline T construct(std::false_type, Args &&...args) {
+    return T{std::forward<Args>(args)...};
+}
+
+// Calls an `each` function, passing the entity only if the function
+// takes it as the first parameter.
+template <typename Func, typename... Args>
+inline void invoke_each(std::true_type, Func &fn, Entity entity,
+                        Args &&...args) {
+    fn(entity, std::forward<Args>(args)...);
+}
+
+template <typename Func, typename... Args>
+inline void invoke_each(std::false_type, Func &fn, Entity, Args &&...args) {
+    fn(std::forward<Args>(args)...);
+}
+
+// Selects the `invoke_each` overload for a function called with `Args`.
+template <typename Func, typename... Args>
+using EachTakesEntity = std::integral_constant<bool,
+    IsCallable<Func &, Entity, Args...>::value>;
+
+template <typename T>
+struct ComponentIndex {
+    static ComponentType value() {
+        static const ComponentType index = next_component_index();
+        return index;
+    }
+};
+
+} // internal
+
+// Returns the index of a component type. The index is assigned the first
+// time it is requested and is used as both the bit in an `EntityMask` and
+// the slot of the component array in a world.
+template <typename T>
+inline ComponentType component_index() {
+    return internal::ComponentIndex<typename std::remove_cv<
+        typename std::remove_reference<T>::type>::type>::value();
+}
+
 // Holds information on which components are attached to an entity.
 // 1 bit is used for each component type.
 // Note: Do not serialize an entity mask since which bit represents a
@@ -192,6 +301,26 @@ inline TWO_ENTITY_INT_TYPE entity_version(Entity entity) {
     return entity >> TWO_ENTITY_VERSION_SHIFT;
 }
 
+namespace internal {
+
+// A paged array indexed by entity index. Pages are only allocated once an
+// index within the page is written to, so a sparse set of indices does not
+// need memory for the whole range. Unset indices read as `Empty`.
+template <typename T, T Empty>
+class SparseArray {
+public:
+    // Returns the value at index `i` or `Empty` if it was never set.
+    inline T get(TWO_ENTITY_INT_TYPE i) const;
+
+    // Sets the value at index `i`, allocating its page if needed.
+    void set(TWO_ENTITY_INT_TYPE i, T value);
+
+private:
+    std::vector<std::unique_ptr<T[]>> pages;
+};
+
+} // internal
+
 // A simple optional type in order to support C++ 11.
 template <typename T>
 class Optional {
@@ -216,11 +345,106 @@ private:
 };
 
 // An empty component that is used to indicate whether the entity it is
-// attached to is currently active.
+// attached to is currently active. Like all empty components it is stored
+// as a tag, see `TagArray`.
 struct Active {};
 
+// Excludes entities that have any of the given components from a view.
+//
+//     view<A, B>(exclude<C, D>());
+template <typename... Components>
+struct Exclude {};
+
+template <typename... Components>
+constexpr Exclude<Components...> exclude() { return {}; }
+
+// Requests an optional component in `each`. The function is passed a
+// pointer to the component which is null if the entity does not have it.
+//
+//     each<A, Maybe<B>>([](A &a, B *b) {});
+template <typename T>
+struct Maybe {};
+
+// A field of a component stored as a structure of arrays, see `SoaLayout`.
+template <typename F, typename T, F T::*Member>
+struct SoaField {
+    using type = F;
+
+    static F &get(T &component) { return component.*Member; }
+    static const F &get(const T &component) { return component.*Member; }
+};
+
+#define TWO_SOA_FIELD(Type, name) \
+    ::two::SoaField<decltype(Type::name), Type, &Type::name>
+
+// Base class for `SoaLayout` specializations.
+template <typename... Fields>
+struct SoaFields {
+    static constexpr bool value = true;
+    using fields = std::tuple<Fields...>;
+};
+
+// Specialize to store a component as a structure of arrays, where each
+// field is stored in its own array. Only the listed fields are stored.
+//
+//     namespace two {
+//     template <>
+//     struct SoaLayout<Position> : SoaFields<
+//         TWO_SOA_FIELD(Position, x), TWO_SOA_FIELD(Position, y)> {};
+//     }
+//
+// Ignored when TWO_STORAGE_ARCHETYPE is defined.
+template <typename T>
+struct SoaLayout {
+    static constexpr bool value = false;
+};
+
 class World;
 
+template <typename... Components>
+class View;
+
+template <typename... Components>
+class Group;
+
+// The components a system reads and writes in `update`, used by
+// `World::schedule_systems` to decide which systems may update at the same
+// time.
+//
+//     two::SystemAccess access() const override {
+//         return two::SystemAccess().read<Velocity>().write<Transform>();
+//     }
+struct SystemAccess {
+    EntityMask reads;
+    EntityMask writes;
+
+    // An exclusive system never updates at the same time as another
+    // system. Systems that add or remove components or create or destroy
+    // entities must be exclusive.
+    bool exclusive;
+
+    explicit SystemAccess(bool exclusive = false) : exclusive{exclusive} {}
+
+    template <typename... Components>
+    SystemAccess &read() {
+        TWO_TEMPLATE_FOLD(reads.set(component_index<Components>()));
+        return *this;
+    }
+
+    template <typename... Components>
+    SystemAccess &write() {
+        TWO_TEMPLATE_FOLD(writes.set(component_index<Components>()));
+        return *this;
+    }
+
+    // Returns true if the systems cannot update at the same time.
+    bool conflicts(const SystemAccess &other) const {
+        return exclusive || other.exclusive
+            || (writes & (other.reads | other.writes)).any()
+            || (reads & other.writes).any();
+    }
+};
+
 // Base class for all systems. The lifetime of systems is managed by a World.
 class System {
 public:
@@ -229,13 +453,20 @@ public:
     virtual void update(World *world, float dt);
     virtual void draw(World *world);
     virtual void unload(World *world);
+
+    // Returns the components read and written by `update`. Systems are
+    // exclusive unless they override this function.
+    virtual SystemAccess access() const;
 };
 
 class IComponentArray {
 public:
     virtual ~IComponentArray() = default;
     virtual bool remove(Entity entity) = 0;
-    virtual void copy(Entity dst, Entity src) = 0;
+
+    // Returns false if the component type cannot be copied, in which case
+    // nothing is written to `dst`.
+    virtual bool copy(Entity dst, Entity src) = 0;
 };
 
 // Manages all instances of a component type and keeps track of which
@@ -243,11 +474,13 @@ public:
 template <typename T>
 class ComponentArray : public IComponentArray {
 public:
-    static_assert(std::is_copy_assignable<T>(),
-                  "Component type must be copy assignable");
+    // Components only need to be copyable to be copied to another entity
+    // with `copy`.
+    static_assert(std::is_move_assignable<T>(),
+                  "Component type must be move assignable");
 
-    static_assert(std::is_copy_constructible<T>(),
-                  "Component type must be copy constructible");
+    static_assert(std::is_move_constructible<T>(),
+                  "Component type must be move constructible");
 
     // Entity int type is used to ensure we can address the maximum
     // number of entities.
@@ -265,6 +498,19 @@ public:
     // component.
     T &write(Entity entity, const T &component);
 
+    // Same as `write(entity, component)` but moves the component into the
+    // packed array.
+    T &write(Entity entity, T &&component);
+
+    // Constructs a component in place at the end of the packed array and
+    // associates an entity with the component. If the entity already has
+    // a component it is replaced with a component constructed from `args`.
+    //
+    // Aggregate types without a matching constructor are initialized
+    // with `T{args...}` and moved into the array.
+    template <typename... Args>
+    T &emplace(Entity entity, Args &&...args);
+
     // Invalidate this component type for an entity. Returns true if the
     // component was removed.
     //
@@ -275,14 +521,39 @@ public:
     // called.
     bool remove(Entity entity) override;
 
-    // Copy component to `dst` from `src`.
-    void copy(Entity dst, Entity src) override;
+    // Copy component to `dst` from `src`. Returns false without copying
+    // if the component type is not copy constructible and copy assignable.
+    bool copy(Entity dst, Entity src) override;
 
     // Returns true if the entity has a component of type T.
     inline bool contains(Entity entity) const;
 
+    // Returns a pointer to the component of an entity or null if the
+    // entity does not have a component of type T. This only needs one
+    // lookup, unlike calling `contains` and then `read`.
+    inline T *find(Entity entity);
+
     // Returns the number of valid components in the packed array.
-    size_t count() const { return packed_count; };
+    size_t count() const { return packed_array.size(); };
+
+    // Returns the entities that own each component in the packed array.
+    // The entity at index `i` owns the component at index `i`, so this
+    // can be used to walk all owners of a component type linearly.
+    // > Note: The order of entities changes when components are removed.
+    const std::vector<Entity> &entities() const { return packed_entities; }
+
+    // Returns the packed array, only the first `count()` components are
+    // valid. The component at index `i` is owned by `entities()[i]`.
+    T *data() { return packed_array.data(); }
+
+    // Returns the index of an entity's component in the packed array or
+    // `InvalidIndex` if the entity does not have the component.
+    size_t index_of(Entity entity) const { return find_index(entity); }
+
+    // Swaps the component of an entity with the component at `index` in
+    // the packed array. Used by groups to keep the components of their
+    // entities at the front of the array.
+    void swap(Entity entity, size_t index);
 
 private:
     // All instances of component type T are stored in a contiguous vector.
@@ -291,1032 +562,4411 @@ private:
     // Maps an Entity id to an index in the packed array.
     std::vector<std::unique_ptr<PackedSizeType[]>> sparse_array;
 
-    // Maps an index in the packed component array to an Entity.
-    std::unordered_map<PackedSizeType, Entity> packed_to_entity;
-
-    // Number of valid entries in the packed array, other entries beyond
-    // this count may be uninitialized or invalid data.
-    size_t packed_count = 0;
+    // Maps an index in the packed component array to an Entity. This runs
+    // parallel to the packed array and always has the same size.
+    std::vector<Entity> packed_entities;
 
     // Returns the index into the packed array from an Entity
     size_t find_index(Entity entity) const;
 
     // Sets the index into the packed array
     void insert_index(Entity entity, PackedSizeType value);
+
+    // Adds an entity to the end of the packed array, the caller must append
+    // the component.
+    void push_entity(Entity entity);
+
+    bool copy_component(std::true_type, Entity dst, Entity src);
+    bool copy_component(std::false_type, Entity dst, Entity src);
+
+    // Appends a component constructed with `T(args...)` if possible,
+    // otherwise with `T{args...}`.
+    template <typename... Args>
+    void emplace_back(std::true_type, Args &&...args);
+
+    template <typename... Args>
+    void emplace_back(std::false_type, Args &&...args);
 };
 
-// An event channel handles events for a single event type.
-template <typename Event>
-class EventChannel {
+// Stores an empty component type, also known as a tag. Every instance of
+// an empty type is the same, so no component is stored per entity: whether
+// an entity has a tag is only stored in its entity mask.
+template <typename T>
+class TagArray : public IComponentArray {
 public:
-    using EventHandler = std::function<bool (const Event &)>;
+    static_assert(std::is_empty<T>(), "Tag type must be empty");
 
-    // Adds a function as an event handler
-    void bind(EventHandler &&fn);
+    // Returns the tag instance shared by all entities. The World must
+    // check the entity mask to know if an entity has the tag.
+    T &read(Entity) { return tag; }
 
-    // Emits an event to all event handlers
-    void emit(const Event &event) const;
+    // Tags have no storage, these functions only return the tag instance.
+    T &write(Entity, const T &) { return tag; }
+
+    template <typename... Args>
+    T &emplace(Entity, Args &&...) { return tag; }
+
+    // Always returns false since the array does not know which entities
+    // have the tag. Removing a tag only clears the bit in the entity mask.
+    bool remove(Entity) override { return false; }
+
+    bool copy(Entity, Entity) override { return true; }
 
 private:
-    std::vector<EventHandler> handlers;
+    T tag;
 };
 
-// A world holds a collection of systems, components and entities.
-class World {
+namespace internal {
+
+#ifdef TWO_STORAGE_ARCHETYPE
+template <typename T>
+struct IsSoa : std::false_type {};
+#else
+template <typename T>
+struct IsSoa : std::integral_constant<bool, SoaLayout<T>::value> {};
+#endif
+
+// Allocates memory aligned to `TWO_SOA_ALIGNMENT`.
+template <typename T>
+class AlignedAllocator {
 public:
+    using value_type = T;
+
+    AlignedAllocator() = default;
+
+    template <typename U>
+    AlignedAllocator(const AlignedAllocator<U> &) {}
+
+    T *allocate(size_t n);
+    void deallocate(T *p, size_t);
+
+    template <typename U>
+    bool operator==(const AlignedAllocator<U> &) const { return true; }
+
+    template <typename U>
+    bool operator!=(const AlignedAllocator<U> &) const { return false; }
+};
+
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+// Operations on every field array of a `SoaLayout`.
+template <typename Fields>
+struct SoaColumns;
+
+template <typename... Fields>
+struct SoaColumns<std::tuple<Fields...>> {
+    using type = std::tuple<AlignedVector<typename Fields::type>...>;
+
+    template <size_t I>
+    using Field = typename std::tuple_element<I, std::tuple<Fields...>>::type;
+
+    // Returns the array of a field.
+    template <typename F>
+    static AlignedVector<typename F::type> &column(type &columns) {
+        return std::get<IndexOf<F, Fields...>::value>(columns);
+    }
+
     template <typename T>
-    using ViewFunc = typename std::common_type<std::function<T>>::type;
+    static void push(type &columns, const T &component);
 
-    World() = default;
+    template <typename T>
+    static void set(type &columns, size_t i, const T &component);
 
-    World(const World &) = delete;
-    World &operator=(const World &) = delete;
+    template <typename T>
+    static void get(type &columns, size_t i, T &component);
 
-    World(World &&) = default;
-    World &operator=(World &&) = default;
+    // Moves the last element of each array to `i`.
+    static void remove(type &columns, size_t i);
 
-    virtual ~World() = default;
+    // Calls `fn(count, fields...)` with a pointer to each field array.
+    template <typename Func>
+    static void apply(type &columns, size_t count, Func &fn);
+};
 
-    // Called before the first frame when the world is created.
-    virtual void load();
+} // internal
 
-    // Called once per per frame after all events have been handled and
-    // before draw.
-    //
-    // > Systems are not updated on their own, you should call update
-    // on systems here. Note that you should not call `draw()` on
-    // each system since that is handled in the main loop.
-    virtual void update(float dt);
+template <typename T>
+class SoaArray;
 
-    // Called before a world is unloaded.
-    //
-    // > Note: When overriding this function you need to call unload
-    // on each system and free them.
-    virtual void unload();
+// A reference to a component stored in a `SoaArray`. The fields of the
+// component are not stored together, so components are read and written
+// as a copy or one field at a time.
+template <typename T>
+class SoaRef {
+public:
+    SoaRef(SoaArray<T> *array, size_t index) : array{array}, index{index} {}
 
-    // Creates a new entity in the world with an Active component.
-    Entity make_entity();
+    // Returns a copy of the component.
+    inline T get() const;
+    operator T() const { return get(); }
 
-    // Creates a new entity and copies components from another.
-    Entity make_entity(Entity archetype);
+    // Writes every field of the component.
+    inline const SoaRef &operator=(const T &component) const;
 
-    // Creates a new inactive entity in the world. The entity will need
-    // to have active set before it can be used by systems.
-    // Useful to create entities without initializing them.
-    // > Note: Inactive entities still exist in the world and can have
-    // components added to them.
-    Entity make_inactive_entity();
+    // Returns a reference to the field at index `I` in the `SoaLayout`.
+    template <size_t I>
+    inline typename SoaArray<T>::template FieldType<I> &field() const;
 
-    // Copy components from entity `src` to entity `dst`.
-    void copy_entity(Entity dst, Entity src);
+private:
+    SoaArray<T> *array;
+    size_t index;
+};
 
-    // Destroys an entity and all of its components.
-    void destroy_entity(Entity entity);
+// Stores a component type as a structure of arrays, used instead of
+// `ComponentArray` for types with a `SoaLayout`. Each field is stored in
+// its own array aligned to TWO_SOA_ALIGNMENT, so a kernel that only
+// touches one field reads contiguous memory.
+template <typename T>
+class SoaArray : public IComponentArray {
+public:
+    static_assert(std::is_default_constructible<T>(),
+                  "Component type must be default constructible");
 
-    // Returns the entity mask
-    inline const EntityMask &get_mask(Entity entity) const;
+    using Layout = typename SoaLayout<T>::fields;
+    using Columns = internal::SoaColumns<Layout>;
 
-    // Adds or replaces a component and associates an entity with the
-    // component.
-    //
-    // Adding components will invalidate the cache. The number of cached views
-    // is *usually* approximately equal to the number of systems, so this
-    // operation is not that expensive but you should avoid doing it every
-    // frame. This does not apply to 're-packing' components (see note below).
-    //
-    // > Note: If the entity already has a component of the same type, the old
-    // component will be replaced. Replacing a component with a new instance
-    // is *much* faster than calling `remove` and then `pack` which
-    // would result in the cache being rebuilt twice. Replacing a component
-    // does not invalidate the cache and is cheap operation.
-    template <typename Component>
-    Component &pack(Entity entity, const Component &component);
+    template <size_t I>
+    using FieldType = typename Columns::template Field<I>::type;
 
-    // Shortcut to pack multiple components to an entity, equivalent to
-    // calling `pack(entity, component)` for each component.
-    //
-    // Unlike the original `pack` function, this function does not return a
-    // reference to the component that was just packed.
-    template <typename C0, typename... Cn>
-    void pack(Entity entity, const C0 &component, const Cn &...components);
+    // Returns a reference to the component of an entity.
+    inline SoaRef<T> read(Entity entity);
 
-    // Returns a component of the given type associated with an entity.
-    // This function will only check if the component does not exist for an
-    // entity if assertions are enabled, otherwise it is unchecked.
-    // Use contains if you need to verify the existence of a component
-    // before removing it. This is a cheap operation.
-    //
-    // This function returns a reference to a component in the packed array.
-    // The reference may become invalid after `remove` is called since `remove`
-    // may move components in memory.
-    //
-    //     auto &a = world.unpack<A>(entity1);
-    //     a.x = 5; // a is a valid reference and x will be updated.
-    //
-    //     auto b = world.unpack<B>(entity1); // copy B
-    //     world.remove<B>(entity2);
-    //     b.x = 5;
-    //     world.pack(entity1, b); // Ensures b will be updated in the array
-    //
-    //     auto &c = world.unpack<C>(entity1);
-    //     world.remove<C>(entity2);
-    //     c.x = 5; // may not update c.x in the array
-    //
-    // If you plan on holding the reference it is better to copy the
-    // component and then pack it again if you have modified the component.
-    // Re-packing a component is a cheap operation and will not invalidate.
-    // the cache.
-    //
-    // > Do not store this reference between frames such as in a member
-    // variable, store the entity instead and call unpack each frame. This
-    // operation is designed to be called multiple times per frame so it
-    // is very fast, there is no need to `cache` a component reference in
-    // a member variable.
-    template <typename Component>
-    inline Component &unpack(Entity entity);
+    // Set a component and associate an entity with the component.
+    SoaRef<T> write(Entity entity, const T &component);
 
-    // Returns true if a component of the given type is associated with an
-    // entity. This is a cheap operation.
-    template <typename Component>
-    inline bool contains(Entity entity) const;
+    template <typename... Args>
+    SoaRef<T> emplace(Entity entity, Args &&...args);
+
+    // Same as `ComponentArray::remove`.
+    bool remove(Entity entity) override;
+
+    bool copy(Entity dst, Entity src) override;
 
-    // Returns true if an entity contains all given components.
-    template <typename C0, typename... Cn,
-        typename Enable = typename std::enable_if<(sizeof...(Cn) > 0)>::type>
     inline bool contains(Entity entity) const;
 
-    // Removes a component from an entity. Removing components invalidates
-    // the cache.
-    //
-    // If the entity does not have the component being removed this function
-    // is a noop and will succeed.
-    template <typename Component>
-    void remove(Entity entity);
+    size_t count() const { return packed_entities.size(); }
 
-    // Adds or removes an Active component.
-    //
-    // > When calling `set_active(entity, true)` with an entity that is already
-    // active this function won't do anything. The same is true when calling
-    // `set_active(entity, false)` with an entity that is already inactive.
-    inline void set_active(Entity entity, bool active);
+    // Returns the entities that own each component. The entity at index
+    // `i` owns the fields at index `i` in each field array.
+    const std::vector<Entity> &entities() const { return packed_entities; }
 
-    // Returns all entities that have all requested components. By default
-    // only entities with an `Active` component are matched unless
-    // `include_inactive` is true.
-    //
-    //     for (auto entity : view<A, B, C>()) {
-    //         auto &a = unpack<A>(entity);
-    //         // ...
-    //     }
-    //
-    // The first call to this function will build a cache with the entities
-    // that contain the requested components, subsequent calls will return
-    // the cached data as long as the data is still valid. If a cache is no
-    // longer valid, this function will rebuild the cache by applying all
-    // necessary diffs to make the cache valid.
-    //
-    // The cost of rebuilding the cache depends on how many diff operations
-    // are needed. Any operation that changes whether an entity should be
-    // in this cache (does the entity have all requested components?) counts
-    // as a single Add or Remove diff. Functions like `remove`,
-    // `make_entity`, `pack`, `destroy_entity` may cause a cache to be
-    // invalidated. Functions that may invalidate the cache are documented.
-    template <typename... Components>
-    const std::vector<Entity> &view(bool include_inactive = false);
+    // Returns the array of the field at index `I` in the `SoaLayout`,
+    // only the first `count()` fields are valid.
+    template <size_t I>
+    FieldType<I> *field() { return std::get<I>(columns).data(); }
 
-    // Calls `fn` with a reference to each unpacked component for every entity
-    // with all requested components.
-    //
-    //     each<A, B, C>([](A &a, B &b, C &c) {
-    //         // ...
-    //     });
-    //
-    // This function calls `view<Components...>()` internally so the same
-    // notes about `view` apply here as well.
-    template <typename... Components>
-    inline void each(ViewFunc<void (Components &...)> &&fn,
-                     bool include_inactive = false);
+    // Calls `fn(count(), fields...)` with a pointer to each field array.
+    template <typename Func>
+    void apply(Func &&fn) { Columns::apply(columns, count(), fn); }
 
-    // Calls `fn` with the entity and a reference to each unpacked component
-    // for every entity with all requested components.
-    //
-    //     each<A, B, C>([](Entity entity, A &a, B &b, C &c) {
-    //         // ...
-    //     });
-    //
-    // This function calls `view<Components...>()` internally so the same
-    // notes about `view` apply here as well.
-    template <typename... Components>
-    inline void each(ViewFunc<void (Entity, Components &...)> &&fn,
-                     bool include_inactive = false);
+    // Returns a copy of the component at index `i`.
+    inline T get(size_t i);
 
-    // Returns the **first** entity that contains all components requested.
-    // Views always keep entities in the order that the entity was
-    // added to the view, so `view_one()` will reliabily return the same
-    // entity that matches the constraints unless the entity was destroyed
-    // or has had one of the required components removed.
-    //
-    // The returned optional will have no value if no entities exist with
-    // all requested components.
-    template <typename... Components>
-    Optional<Entity> view_one(bool include_inactive = false);
+    // Writes every field of the component at index `i`.
+    inline void set(size_t i, const T &component);
 
-    // Finds the first entity with the requested component and unpacks
-    // the component requested. This is convenience function for getting at
-    // a single component in a single entity.
-    //
-    //     auto camera = world.unpack_one<Camera>();
-    //
-    //     // is equivalent to
-    //     auto entity = world.view_one<Camera>().value();
-    //     auto camera = world.unpack<Camera>(entity);
-    //
-    // Unlike `view_one()` this function will panic if no entities with
-    // the requested component were matched. Only use this function if not
-    // matching any entity should be an error, if not use `view_one()`
-    // instead.
-    template <typename Component>
-    Component &unpack_one(bool include_inactive = false);
+private:
+    typename Columns::type columns;
+    std::vector<Entity> packed_entities;
 
-    // Returns all entities in the world. Entities returned may be inactive.
-    // > Note: Calling `destroy_entity()` will invalidate the iterator, use
-    // `view<>(true)` to get all entities without having `destroy_entity()`
-    // invalidate the iterator.
-    inline const std::vector<Entity> &unsafe_view_all() { return entities; }
+    // Maps an entity index to an index in the field arrays.
+    internal::SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> indices;
+};
 
-    // Creates and adds a system to the world. This function calls
-    // `System::load` to initialize the system.
-    //
-    // > Systems are not unique. 'Duplicate' systems, that is different
-    // instances of the same system type, are allowed in the world.
-    template <class T, typename... Args>
-    T *make_system(Args &&...args);
+// The type returned when reading a component, `SoaRef<T>` for components
+// stored as a structure of arrays.
+template <typename T>
+using ComponentRef = typename std::conditional<
+    internal::IsSoa<T>::value, SoaRef<T>, T &>::type;
 
-    // Adds a system to the world. This function calls `System::load` to
-    // initialize the system.
-    //
-    // > You may add multiple different instances of the same system type,
-    // but passing a system pointer that points to an instance that is
-    // already in the world is not allowed and will not be checked by default.
-    // Enable `TWO_PARANOIA` to check for duplicate pointers.
-    template <class T>
-    T *make_system(T *system);
+#ifdef TWO_STORAGE_ARCHETYPE
 
-    // Adds a system to the world before another system if it exists.
-    // `Before` is an existing system.
-    // `T` is the system to be added before an existing system.
-    template <class Before, class T, typename... Args>
-    T *make_system_before(Args &&...args);
+namespace internal {
 
-    // Returns the first system that matches the given type.
-    // System returned will be `nullptr` if it is not found.
-    template <class T>
-    T *get_system();
+// A type erased column in an archetype table.
+class IColumn {
+public:
+    virtual ~IColumn() = default;
 
-    // Returns all system that matches the given type.
-    // Systems returned will not be null.
-    template <class T>
-    void get_all_systems(std::vector<T *> *systems);
+    // Removes the component at `row` by moving the last component into it.
+    // If `dst` is not null the component is first moved to the end of
+    // `dst`, which must be a column of the same type.
+    virtual void move_row(size_t row, IColumn *dst) = 0;
+};
 
-    // System must not be null. Do not destroy a system while the main update
-    // loop is running as it could invalidate the system iterator, consider
-    // checking if the system should run or not in the system update loop
-    // instead.
-    void destroy_system(System *system);
+template <typename T>
+using ColumnVector = std::vector<T, TWO_COMPONENT_ARRAY_ALLOCATOR<T>>;
 
-    // Destroy all systems in the world.
-    void destroy_systems();
+template <typename T>
+class Column : public IColumn {
+public:
+    ColumnVector<T> data;
 
-    // Systems returned will not be null.
-    inline const std::vector<System *> &systems() { return active_systems; }
+    void move_row(size_t row, IColumn *dst) override;
 
-    // Adds a function to receive events of type T
-    template <typename Event>
-    void bind(typename EventChannel<Event>::EventHandler &&fn);
+    static IColumn *make() { return new Column<T>; }
+};
 
-    // Same as `bind(fn)` but allows a member function to be used
-    // as an event handler.
-    //
-    //     bind<KeyDownEvent>(&World::keydown, this);
-    template <typename Event, typename Func, class T>
-    void bind(Func &&fn, T this_ptr);
+// Stores the components of all entities that have the same entity mask.
+// Row `i` of every column belongs to `entities[i]`.
+struct Archetype {
+    EntityMask mask;
+    TWO_ENTITY_INT_TYPE id;
+    std::vector<Entity> entities;
 
-    // Emits an event to all event handlers. If a handler function in the
-    // chain returns true then the event is considered handled and will
-    // not propagate to other listeners.
-    template <typename Event>
-    void emit(const Event &event) const;
+    // Component types that have a column, tags have no column.
+    std::vector<ComponentType> types;
 
-    // Removes all event handlers, you'll unlikely need to call this since
-    // events are cleared when the world is destroyed.
-    inline void clear_event_channels() { channels.clear(); };
+    // Columns indexed by component type.
+    std::vector<std::unique_ptr<IColumn>> columns;
 
-    // Components will be registered on their own if a new type of component is
-    // added to an entity. There is no need to call this function unless you
-    // are doing something specific that requires it.
-    template <typename Component>
-    void register_component();
+    // Returns the column for a component type or null if this table does
+    // not store the component.
+    template <typename T>
+    ColumnVector<T> *column(ComponentType type);
+};
 
-    // Registers a component type if it does not exist and returns it.
-    // Components are registered automatically so there is usually no reason
-    // to call this function.
-    template <typename Component>
-    inline ComponentType find_or_register_component();
+// Owns the archetype tables of a world and keeps track of the table and
+// row of each entity.
+class ArchetypeStore {
+public:
+    using MakeColumn = IColumn *(*)();
+
+    // Sets the function used to create columns for a component type.
+    // Types without a column function are stored as tags.
+    void register_column(ComponentType type, MakeColumn make);
+
+    // Returns the table of an entity and sets `row`, or returns null if
+    // the entity is not in any table.
+    inline Archetype *find(Entity entity, size_t *row) const;
+
+    // Moves an entity to the table for `mask`, moving its components and
+    // destroying the components that are not in `mask`. Columns for new
+    // components are left one row short and the caller must append the
+    // new components.
+    void move(Entity entity, const EntityMask &mask);
+
+    // Returns all tables. Tables are never destroyed so new tables are
+    // always added to the end.
+    const std::vector<std::unique_ptr<Archetype>> &tables() const {
+        return archetypes;
+    }
 
-    // Recycles entity ids so that they can be safely reused. This function
-    // exists to ensure we don't reuse entity ids that are still present in
-    // some cache even though the entity has been destroyed. This can happen
-    // since cache operations are done in a 'lazy' manner.
-    // This function should be called at the end of each frame.
-    void collect_unused_entities();
+private:
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::unordered_map<EntityMask, Archetype *> lookup;
+    std::array<MakeColumn, TWO_COMPONENT_MAX> factories{};
+
+    // Maps an entity index to the id of its table and its row.
+    SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> entity_tables;
+    SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> entity_rows;
+
+    Archetype *find_or_make(const EntityMask &mask);
+};
+
+} // internal
+
+// Stores a component type in the archetype tables of a world, used in
+// place of `ComponentArray` when TWO_STORAGE_ARCHETYPE is defined. Adding
+// or removing a component moves all components of the entity to another
+// table, but `each` can walk each table's columns linearly.
+template <typename T>
+class ArchetypeArray : public IComponentArray {
+public:
+    static_assert(std::is_move_assignable<T>(),
+                  "Component type must be move assignable");
+
+    static_assert(std::is_move_constructible<T>(),
+                  "Component type must be move constructible");
+
+    explicit ArchetypeArray(internal::ArchetypeStore *store);
+
+    // Same as `ComponentArray::read`.
+    inline T &read(Entity entity);
+
+    // Sets the component of an entity, moving the entity to a table with
+    // this component if it does not have one.
+    T &write(Entity entity, const T &component);
+    T &write(Entity entity, T &&component);
+
+    template <typename... Args>
+    T &emplace(Entity entity, Args &&...args);
+
+    // Moves the entity to a table without this component. Returns true if
+    // the component was removed.
+    bool remove(Entity entity) override;
+
+    bool copy(Entity dst, Entity src) override;
+
+    inline bool contains(Entity entity) const;
+
+    // Returns a pointer to the component of an entity or null if the
+    // entity does not have a component of type T.
+    inline T *find(Entity entity) const;
 
 private:
-    // Used to speed up entity lookups
-    struct EntityCache {
-        struct Diff {
-            enum Operation { Add, Remove };
-            Entity entity;
-            Operation op;
-        };
-        std::vector<Entity> entities;
-        std::vector<Diff> diffs;
-        std::unordered_set<Entity> lookup;
-    };
+    internal::ArchetypeStore *store;
+    ComponentType type;
 
-    struct DestroyedEntity {
-        Entity entity;
-        // Caches that needs to be rebuilt before the entity can be reused
-        std::vector<EntityCache *> caches;
-    };
+    // Returns the column of the entity's table, first moving the entity to
+    // a table with this component if needed. The entity does not have the
+    // component yet if `row` is the size of the column.
+    internal::ColumnVector<T> *prepare(Entity entity, size_t *row);
 
-    size_t component_type_index = 0;
-    size_t alive_count = 0;
+    bool copy_component(std::true_type, Entity dst, Entity src);
+    bool copy_component(std::false_type, Entity dst, Entity src);
+};
 
-    // Systems cannot outlive World.
-    std::vector<System *> active_systems;
+namespace internal {
 
-    // Kept separate since most of the time we just want to iterate through
-    // all the systems and do not need to know their types.
-    std::vector<type_id_t> active_system_types;
+template <typename T>
+TagArray<T> *make_storage(std::true_type, ArchetypeStore *) {
+    return new TagArray<T>;
+}
 
-    // Contains available entity ids. When creating entities check if this
-    // is not empty, otherwise use alive_count + 1 as the new id.
-    std::vector<Entity> unused_entities;
+template <typename T>
+ArchetypeArray<T> *make_storage(std::false_type, ArchetypeStore *store) {
+    return new ArchetypeArray<T>(store);
+}
 
-    // Contains available entity ids that may still be present in
-    // some cache. Calling `collect_unused_entities()` will remove the
-    // entity from the caches so that the entity can be reused.
-    std::vector<DestroyedEntity> destroyed_entities;
+} // internal
+
+// The storage used for a component type. Empty components are stored in
+// a `TagArray` and all other components in an `ArchetypeArray`.
+template <typename T>
+using ComponentStorage = typename std::conditional<
+    std::is_empty<T>::value, TagArray<T>, ArchetypeArray<T>>::type;
+
+#else
+
+// The storage used for a component type. Empty components are stored in
+// a `TagArray`, components with a `SoaLayout` in a `SoaArray` and all
+// other components in a `ComponentArray`.
+template <typename T>
+using ComponentStorage = typename std::conditional<
+    std::is_empty<T>::value, TagArray<T>,
+    typename std::conditional<internal::IsSoa<T>::value,
+        SoaArray<T>, ComponentArray<T>>::type>::type;
+
+#endif
+
+namespace internal {
+
+template <typename C>
+struct IsMaybe : std::false_type {};
+
+template <typename T>
+struct IsMaybe<Maybe<T>> : std::true_type {};
+
+// The component type stored for a requested component, `T` for
+// `Maybe<T>`.
+template <typename C>
+struct StoredType { using type = C; };
+
+template <typename T>
+struct StoredType<Maybe<T>> {
+    static_assert(!std::is_empty<T>(),
+                  "Maybe is not supported for tags, use World::contains");
+    static_assert(!IsSoa<T>(),
+                  "Maybe is not supported for structure of arrays components");
+    using type = T;
+};
+
+// The type an `each` function takes for a requested component, `T *`
+// for `Maybe<T>`.
+template <typename C>
+struct EachParam { using type = ComponentRef<C>; };
+
+template <typename T>
+struct EachParam<Maybe<T>> { using type = T *; };
+
+// The storage of a requested component.
+template <typename C>
+using StorageOf = ComponentStorage<typename StoredType<C>::type>;
+
+// Pointers to the storage of each component type in `Components`.
+template <typename... Components>
+using StoragePtrs = std::tuple<StorageOf<Components> *...>;
+
+// True if a component is stored in a `ComponentArray`. Tags and
+// structure of arrays components have no packed array of `T`.
+template <typename T>
+struct IsPacked : std::integral_constant<bool,
+    !std::is_empty<T>::value && !IsSoa<T>::value> {};
+
+// True if the type at index `I` in `Ts` has no packed array, false if `I`
+// is out of range.
+template <size_t I, typename... Ts>
+struct IsUnpackedAt : std::false_type {};
+
+template <typename T, typename... Ts>
+struct IsUnpackedAt<0, T, Ts...>
+    : std::integral_constant<bool, !IsPacked<T>::value> {};
+
+template <size_t I, typename T, typename... Ts>
+struct IsUnpackedAt<I, T, Ts...> : IsUnpackedAt<I - 1, Ts...> {};
+
+// True if all types in `Ts` are stored in a `ComponentArray`.
+template <typename... Ts>
+struct AllPacked : std::true_type {};
+
+template <typename T, typename... Ts>
+struct AllPacked<T, Ts...> : std::integral_constant<bool,
+    IsPacked<T>::value && AllPacked<Ts...>::value> {};
+
+// Returns the component `C` of an entity, or a pointer to the component
+// that is null if the entity does not have it when `C` is `Maybe<T>`.
+template <typename C, typename... Components>
+inline ComponentRef<C> each_lookup(
+        std::false_type, StoragePtrs<Components...> &arrays, Entity entity) {
+    return std::get<IndexOf<C, Components...>::value>(arrays)->read(entity);
+}
+
+template <typename C, typename... Components>
+inline typename EachParam<C>::type each_lookup(
+        std::true_type, StoragePtrs<Components...> &arrays, Entity entity) {
+    return std::get<IndexOf<C, Components...>::value>(arrays)->find(entity);
+}
+
+// Returns the component `C` of an entity while `each` is driven by the
+// packed array of `Driver`, where `i` is the entity's packed index.
+template <typename C, typename Driver, typename... Components>
+inline C &each_component(std::true_type, StoragePtrs<Components...> &arrays,
+                         size_t i, Entity) {
+    return std::get<IndexOf<C, Components...>::value>(arrays)->data()[i];
+}
+
+template <typename C, typename Driver, typename... Components>
+inline typename EachParam<C>::type each_component(
+        std::false_type, StoragePtrs<Components...> &arrays, size_t,
+        Entity entity) {
+    return each_lookup<C, Components...>(IsMaybe<C>(), arrays, entity);
+}
+
+template <size_t I, typename... Components, typename Func>
+inline typename std::enable_if<(I == sizeof...(Components)), bool>::type
+each_packed(Func &, StoragePtrs<Components...> &, size_t) {
+    return false;
+}
+
+template <size_t I, typename... Components, typename Func>
+inline typename std::enable_if<(I < sizeof...(Components)
+    && !IsUnpackedAt<I, Components...>::value), bool>::type
+each_packed(Func &fn, StoragePtrs<Components...> &arrays, size_t view_size);
+
+template <size_t I, typename... Components, typename Func>
+inline typename std::enable_if<(I < sizeof...(Components)
+    && IsUnpackedAt<I, Components...>::value), bool>::type
+each_packed(Func &fn, StoragePtrs<Components...> &arrays, size_t view_size) {
+    // Tags and structure of arrays components have no packed array, and
+    // entities in the view may not have a `Maybe` component since
+    // `Maybe<T>` is also an empty type.
+    return each_packed<I + 1, Components...>(fn, arrays, view_size);
+}
+
+// Calls an `each` function by walking the packed array of the first
+// component that is owned only by entities in the view, so that component
+// does not need a sparse lookup. Returns false if no such component exists.
+//
+// The array is walked backwards so the function may remove the current
+// entity's components, since the component moved into its place has
+// already been visited.
+template <size_t I, typename... Components, typename Func>
+inline typename std::enable_if<(I < sizeof...(Components)
+    && !IsUnpackedAt<I, Components...>::value), bool>::type
+each_packed(Func &fn, StoragePtrs<Components...> &arrays, size_t view_size) {
+    using Driver = typename std::tuple_element<
+        I, std::tuple<Components...>>::type;
+    using TakesEntity =
+        EachTakesEntity<Func, typename EachParam<Components>::type...>;
+
+    auto *driver = std::get<I>(arrays);
+    if (driver->count() != view_size) {
+        // Some entities with this component are not in the view
+        return each_packed<I + 1, Components...>(fn, arrays, view_size);
+    }
+    const auto &owners = driver->entities();
+    for (size_t i = driver->count(); i-- > 0;) {
+        if (UNLIKELY(i >= driver->count())) {
+            // More than one component was removed by the function
+            i = driver->count();
+            continue;
+        }
+        auto entity = owners[i];
+        invoke_each(TakesEntity(), fn, entity,
+            each_component<Components, Driver, Components...>(
+                std::is_same<Components, Driver>(), arrays, i, entity)...);
+    }
+    return true;
+}
+
+// Ranges of `World::par_each` smaller than this are not worth handing to
+// another thread.
+constexpr size_t ParEachMinRange = 1024;
+
+// Calls an `each` function for the entities at `[begin, end)` in a view.
+template <typename... Components, typename Func>
+inline void each_in_range(const std::vector<Entity> &view, size_t begin,
+                          size_t end, StoragePtrs<Components...> &arrays,
+                          Func &fn) {
+    using TakesEntity =
+        EachTakesEntity<Func, typename EachParam<Components>::type...>;
+
+    for (size_t i = begin; i < end; ++i) {
+        auto entity = view[i];
+        invoke_each(TakesEntity(), fn, entity,
+            each_lookup<Components, Components...>(
+                IsMaybe<Components>(), arrays, entity)...);
+    }
+}
+
+// Calls an `each` function for every entity in a view.
+template <typename... Components, typename Func>
+inline void each_in_view(const std::vector<Entity> &view,
+                         StoragePtrs<Components...> &arrays, Func &fn) {
+    using TakesEntity =
+        EachTakesEntity<Func, typename EachParam<Components>::type...>;
+    static_assert(TakesEntity::value || IsCallable<Func &,
+                      typename EachParam<Components>::type...>::value,
+                  "Function must take (Components &...) or "
+                  "(Entity, Components &...)");
+
+    if (each_packed<0, Components...>(fn, arrays, view.size())) {
+        return;
+    }
+    each_in_range<Components...>(view, 0, view.size(), arrays, fn);
+}
+
+#ifdef TWO_STORAGE_ARCHETYPE
+
+// Reads a requested component from the rows of a table in `each`.
+template <typename C, bool Tag = std::is_empty<C>::value>
+class RowReader {
+public:
+    RowReader(Archetype *table, StorageOf<C> *)
+        : column{table->column<C>(component_index<C>())} {}
+
+    C &get(size_t row) { return (*column)[row]; }
+
+private:
+    // The column may be reallocated by the function, so the pointer to
+    // the vector is kept rather than the pointer to its data.
+    ColumnVector<C> *column;
+};
+
+template <typename C>
+class RowReader<C, true> {
+public:
+    RowReader(Archetype *, TagArray<C> *tags)
+        : tag{&tags->read(NullEntity)} {}
+
+    C &get(size_t) { return *tag; }
+
+private:
+    C *tag;
+};
+
+template <typename T>
+class RowReader<Maybe<T>, true> {
+public:
+    RowReader(Archetype *table, StorageOf<Maybe<T>> *)
+        : column{table->column<T>(component_index<T>())} {}
+
+    T *get(size_t row) { return column ? &(*column)[row] : nullptr; }
+
+private:
+    ColumnVector<T> *column;
+};
+
+// Calls an `each` function for every row in a table. Rows are visited
+// backwards for the same reason as in `each_packed`.
+template <typename TakesEntity, typename Func, typename... Readers>
+inline void each_row(TakesEntity, Func &fn, const std::vector<Entity> &rows,
+                     Readers... readers) {
+    for (size_t row = rows.size(); row-- > 0;) {
+        if (UNLIKELY(row >= rows.size())) {
+            // More than one entity was moved out of the table
+            row = rows.size();
+            continue;
+        }
+        invoke_each(TakesEntity(), fn, rows[row], readers.get(row)...);
+    }
+}
+
+// Calls an `each` function for the rows at `[begin, end)` in a table.
+// Rows are visited forwards since the table cannot change, see
+// `World::par_each`.
+template <typename TakesEntity, typename Func, typename... Readers>
+inline void each_row_range(TakesEntity, Func &fn,
+                           const std::vector<Entity> &rows, size_t begin,
+                           size_t end, Readers... readers) {
+    for (size_t row = begin; row < end; ++row) {
+        invoke_each(TakesEntity(), fn, rows[row], readers.get(row)...);
+    }
+}
+
+// Calls an `each` function for every entity in the tables matched by a
+// view.
+template <typename... Components, typename Func>
+inline void each_in_tables(const std::vector<Archetype *> &tables,
+                           StoragePtrs<Components...> &arrays, Func &fn) {
+    using TakesEntity =
+        EachTakesEntity<Func, typename EachParam<Components>::type...>;
+    static_assert(TakesEntity::value || IsCallable<Func &,
+                      typename EachParam<Components>::type...>::value,
+                  "Function must take (Components &...) or "
+                  "(Entity, Components &...)");
+
+    // The function may create new tables, only the tables that exist
+    // now are visited.
+    for (size_t i = 0, count = tables.size(); i < count; ++i) {
+        auto *table = tables[i];
+        each_row(TakesEntity(), fn, table->entities,
+            RowReader<Components>(table,
+                std::get<IndexOf<Components, Components...>::value>(
+                    arrays))...);
+    }
+}
+
+#endif
+
+} // internal
+
+template <typename Signature>
+class Delegate;
+
+// A function pointer and the state it is called with, used instead of
+// `std::function` for event handlers and jobs. Callables up to the size of four
+// pointers, such as lambdas with a few captures or a member function bound
+// to an object, are stored inline. Larger callables are allocated.
+//
+//     Delegate<bool (const KeyDown &)> a([](const KeyDown &) { ... });
+//     Delegate<bool (const KeyDown &)> b(&Player::keydown, player);
+//
+// Delegates can be moved but not copied.
+template <typename R, typename... Args>
+class Delegate<R (Args...)> {
+public:
+    Delegate() = default;
+    Delegate(std::nullptr_t) {}
+
+    template <typename Func, typename = typename std::enable_if<
+        !std::is_same<typename std::decay<Func>::type, Delegate>::value>::type>
+    Delegate(Func &&fn);
+
+    // Calls `((*object).*method)(args...)`.
+    template <typename Method, class T>
+    Delegate(Method method, T object);
+
+    Delegate(Delegate &&other) noexcept;
+    Delegate &operator=(Delegate &&other) noexcept;
+
+    Delegate(const Delegate &) = delete;
+    Delegate &operator=(const Delegate &) = delete;
+
+    ~Delegate() { reset(); }
+
+    R operator()(Args... args) const {
+        return call(storage, std::forward<Args>(args)...);
+    }
+
+    explicit operator bool() const { return call != nullptr; }
+
+private:
+    using Storage = typename std::aligned_storage<
+        4 * sizeof(void *), alignof(std::max_align_t)>::type;
+
+    template <typename Method, class T>
+    struct MemberCall {
+        Method method;
+        T object;
+
+        R operator()(Args... args) {
+            return ((*object).*method)(std::forward<Args>(args)...);
+        }
+    };
+
+    // Callables that are copied as bytes do not need `manage`.
+    template <typename F>
+    using IsTrivial = std::integral_constant<bool,
+        std::is_trivially_copyable<F>::value
+        && std::is_trivially_destructible<F>::value>;
+
+    template <typename F>
+    using IsInline = std::integral_constant<bool,
+        sizeof(F) <= sizeof(Storage) && alignof(F) <= alignof(Storage)
+        && std::is_nothrow_move_constructible<F>::value>;
+
+    mutable Storage storage;
+    R (*call)(Storage &storage, Args... args) = nullptr;
+
+    // Moves the callable from `src` to `dst`, or destroys it if `dst` is
+    // null. Null if the callable is trivial.
+    void (*manage)(Storage *dst, Storage *src) = nullptr;
+
+    template <typename F>
+    void init(F &&fn, std::true_type);
+
+    template <typename F>
+    void init(F &&fn, std::false_type);
+
+    inline void reset();
+
+    template <typename F>
+    static R call_inline(Storage &storage, Args... args);
+
+    template <typename F>
+    static R call_allocated(Storage &storage, Args... args);
+
+    template <typename F>
+    static void manage_inline(Storage *dst, Storage *src);
+
+    template <typename F>
+    static void manage_allocated(Storage *dst, Storage *src);
+};
+
+class ThreadPool;
+
+namespace internal {
+
+// An atomic counter that can be moved along with its owner. Moving is not
+// thread safe.
+template <typename T>
+class MovableAtomic {
+public:
+    MovableAtomic() = default;
+    MovableAtomic(MovableAtomic &&other) : value{other.value.load()} {}
+
+    MovableAtomic &operator=(MovableAtomic &&other) {
+        value = other.value.load();
+        return *this;
+    }
+
+    T operator++() { return ++value; }
+    T operator--() { return --value; }
+    operator T() const { return value.load(); }
+
+    // Returns the value before adding `n`.
+    T fetch_add(T n) { return value.fetch_add(n, std::memory_order_relaxed); }
+
+    void store(T n) { value.store(n); }
+
+private:
+    std::atomic<T> value{0};
+};
+
+using MovableCounter = MovableAtomic<int>;
+
+// A mutex that can be moved along with its owner. A moved mutex is a new
+// unlocked mutex.
+class MovableMutex {
+public:
+    MovableMutex() = default;
+    MovableMutex(MovableMutex &&) {}
+    MovableMutex &operator=(MovableMutex &&) { return *this; }
+
+    std::mutex &get() { return mutex; }
+
+private:
+    std::mutex mutex;
+};
+
+struct JobData;
+
+// Counts references to a job record, which is returned to its pool once
+// the last reference is released.
+class JobPtr {
+public:
+    JobPtr() = default;
+    JobPtr(std::nullptr_t) {}
+    explicit inline JobPtr(JobData *data);
+    JobPtr(const JobPtr &other) : JobPtr(other.data) {}
+    JobPtr(JobPtr &&other) noexcept : data{other.data} { other.data = nullptr; }
+    ~JobPtr() { reset(); }
+
+    JobPtr &operator=(JobPtr other) noexcept {
+        std::swap(data, other.data);
+        return *this;
+    }
+
+    inline void reset();
+
+    JobData *operator->() const { return data; }
+    explicit operator bool() const { return data != nullptr; }
+
+private:
+    JobData *data = nullptr;
+};
+
+// A job scheduled on a `ThreadPool`, see `ThreadPool::make_job`. Records
+// are reused by the pool that made them.
+struct JobData {
+    Delegate<void ()> fn;
+
+    ThreadPool *pool = nullptr;
+
+    // The queue whose free list the record is returned to.
+    size_t queue = 0;
+
+    // Handles, queues and other jobs referring to this job.
+    std::atomic<int> references{0};
+
+    // Not finished until this job finishes.
+    JobPtr parent;
+
+    // This job plus its children that have not finished.
+    std::atomic<int> unfinished{1};
+
+    // Dependencies that have not finished, plus one until the job is
+    // scheduled. The job is queued once this reaches zero.
+    std::atomic<int> waiting{1};
+
+    std::atomic<bool> finished{false};
+
+    // Guards `continuations` against a dependency that is finishing.
+    std::mutex mutex;
+
+    // Jobs that depend on this job.
+    std::vector<JobPtr> continuations;
+};
+
+} // internal
+
+// A handle to a job, see `ThreadPool::make_job`. A default constructed
+// job is empty. Handles must not outlive the pool that made the job, which
+// is checked when assertions are enabled.
+class Job {
+public:
+    Job() = default;
+
+    // Returns true once the job and all of its children have finished.
+    bool done() const {
+        return data->finished.load(std::memory_order_acquire);
+    }
+
+    explicit operator bool() const { return static_cast<bool>(data); }
+
+private:
+    friend class ThreadPool;
+
+    internal::JobPtr data;
+
+    explicit Job(internal::JobPtr &&data) : data{std::move(data)} {}
+};
+
+// A work stealing job scheduler. Each thread has its own queue of jobs
+// and takes jobs from other queues when its own queue is empty. Threads
+// that are not part of the pool share one queue, and a thread waiting on
+// a job runs other jobs until it has finished. A pool of `n` threads
+// starts `n - 1` workers which sleep while there are no jobs.
+//
+//     auto frame = pool.make_job([] {});
+//     auto a = pool.make_job([] { /* ... */ }, frame);
+//     auto b = pool.make_job([] { /* runs after a */ }, frame);
+//     pool.depends_on(b, a);
+//     pool.schedule(a);
+//     pool.schedule(b);
+//     pool.schedule(frame);
+//     pool.wait(frame);
+class ThreadPool {
+public:
+    // Starts one thread per hardware thread if `threads` is 0.
+    explicit inline ThreadPool(size_t threads = 0);
+
+    // Jobs that have not finished are discarded.
+    inline ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Returns the number of threads, including the calling thread.
+    size_t size() const { return workers.size() + 1; }
+
+    // Returns the index of the calling thread in `[0, size())`. Threads
+    // that are not part of the pool share index 0.
+    inline size_t thread_index() const;
+
+    // Returns true if the calling thread is a worker of a different pool,
+    // `thread_index()` is 0 for those threads as well.
+    inline bool other_pool_thread() const;
+
+    // Creates a job that calls `fn` once it is scheduled and all of its
+    // dependencies have finished. A job with a `parent` is a child of the
+    // parent, the parent is not finished until all of its children have
+    // finished. Children must be created before the parent finishes, such
+    // as before the parent is scheduled or from the parent's function.
+    template <typename Func>
+    Job make_job(Func &&fn, const Job &parent = Job());
+
+    // Makes `job` wait until `dependency` and its children have finished.
+    // Must be called before `job` is scheduled.
+    inline void depends_on(const Job &job, const Job &dependency);
+
+    // Queues a job to run once all of its dependencies have finished. Each
+    // job must be scheduled exactly once.
+    inline void schedule(const Job &job);
+
+    // Runs jobs on the calling thread until `job` and its children have
+    // finished. Blocks while there are no jobs to run.
+    inline void wait(const Job &job);
+
+    // Calls `fn(i)` for every `i` in `[0, count)` as children of one job
+    // and waits for them to finish. Calls may run at the same time on
+    // different threads.
+    template <typename Func>
+    void run(size_t count, Func &&fn);
+
+private:
+    friend class internal::JobPtr;
+
+    using JobPtr = internal::JobPtr;
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<JobPtr> jobs;
+
+        // Finished job records that were made by this thread and can be
+        // reused by `make_job`.
+        std::mutex free_mutex;
+        std::vector<internal::JobData *> free_jobs;
+
+        // Number of records made by this thread.
+        size_t records = 0;
+    };
+
+    // The pool and queue of the current thread.
+    struct ThreadQueue {
+        const ThreadPool *pool;
+        size_t index;
+    };
+
+    std::vector<std::thread> workers;
+
+    // One queue per worker, queue 0 is shared by threads outside the pool.
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    // Number of jobs in all queues, plus jobs that are being pushed.
+    std::atomic<size_t> queued{0};
+
+    // Number of workers and waiting threads blocked on `wake`, so pushing a
+    // job only has to lock `mutex` if a thread is asleep.
+    std::atomic<size_t> sleeping{0};
+
+    // Number of threads blocked in `wait`, which are woken whenever a job
+    // finishes.
+    std::atomic<size_t> waiters{0};
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    inline void work(size_t index);
+
+    static inline ThreadQueue &thread_queue();
+
+    inline void push(JobPtr &&job);
+
+    // Takes a free job record of the calling thread, or allocates one.
+    inline internal::JobData *acquire();
+
+    // Called when the last reference to `job` is released.
+    inline void release(internal::JobData *job);
+
+    // Pops the newest job from queue `index`, or steals the oldest job
+    // from another queue. Returns null if there are no jobs.
+    inline JobPtr pop(size_t index);
+
+    inline void execute(JobPtr &&job);
+
+    // Called when a job or one of its children has finished.
+    inline void finish(JobPtr job);
+};
+
+class IEventChannel {
+public:
+    virtual ~IEventChannel() = default;
+    virtual void collect() = 0;
+    virtual void dispatch() = 0;
+    virtual void resize(size_t threads) = 0;
+};
+
+// An event channel handles events for a single event type.
+template <typename Event>
+class EventChannel : public IEventChannel {
+public:
+    using EventHandler = Delegate<bool (const Event &)>;
+    using BatchHandler = Delegate<void (size_t count, const Event *)>;
+
+    // Makes one queue for each of `threads` threads.
+    explicit EventChannel(size_t threads = 1) { resize(threads); }
+
+    // Adds a function as an event handler
+    void bind(EventHandler &&fn);
+
+    // Adds a function that receives all queued events at once
+    void bind_batch(BatchHandler &&fn);
+
+    // Emits an event to all event handlers
+    void emit(const Event &event) const;
+
+    // Adds an event to the queue of a thread, see `World::enqueue`.
+    template <typename T>
+    void enqueue(size_t thread, T &&event);
+
+    // Takes the queued events to be delivered by `dispatch`. Events
+    // queued after this are delivered by the next dispatch.
+    void collect() override;
+
+    // Delivers the collected events, see `World::dispatch_events`.
+    void dispatch() override;
+
+    // Adds queues until there is one for each of `threads` threads.
+    void resize(size_t threads) override;
+
+private:
+    std::vector<EventHandler> handlers;
+    std::vector<BatchHandler> batch_handlers;
+
+    // One queue per thread, allocated separately so that threads do not
+    // write to the same cache line.
+    std::vector<std::unique_ptr<std::vector<Event>>> queues;
+
+    // Events collected for dispatch, kept to reuse memory.
+    std::vector<Event> events;
+    std::vector<bool> handled;
+};
+
+// Records structural changes to be applied to a world later, so that
+// entities can be created and changed from jobs while the world is read
+// on other threads. Commands are stored in blocks of memory that are
+// reused once the buffer has been played back.
+//
+//     auto &commands = world->commands();
+//     auto entity = commands.make_entity();
+//     commands.pack(entity, Position{0, 0});
+//     commands.destroy_entity(other);
+//
+//     // Once the jobs have finished
+//     world->playback_commands();
+//
+// > A command buffer is only valid for the lifetime of the world that
+// created it, and is invalidated if that world is moved.
+class CommandBuffer {
+public:
+    explicit CommandBuffer(World *world) : world{world} {}
+    ~CommandBuffer() { clear(); }
+
+    CommandBuffer(const CommandBuffer &) = delete;
+    CommandBuffer &operator=(const CommandBuffer &) = delete;
+
+    // Returns a new entity that is created when the commands are played
+    // back, and is given an Active component. Until then the entity may
+    // only be used with command buffers of the same world.
+    inline Entity make_entity();
+
+    // Same as `make_entity` but the entity is not given an Active
+    // component.
+    inline Entity make_inactive_entity();
+
+    // Records adding or replacing a component.
+    template <typename Component>
+    void pack(Entity entity, Component &&component);
+
+    // Records adding or replacing multiple components.
+    template <typename C0, typename C1, typename... Cn>
+    void pack(Entity entity, C0 &&c0, C1 &&c1, Cn &&...components);
+
+    // Records removing a component, the component must be registered by
+    // the time the commands are played back.
+    template <typename Component>
+    void remove(Entity entity);
+
+    // Records destroying an entity and all of its components.
+    inline void destroy_entity(Entity entity);
+
+    bool empty() const { return head == nullptr; }
+
+    // Discards the recorded commands. Entities returned by `make_entity`
+    // are still created, without components.
+    inline void clear();
+
+private:
+    friend class World;
+
+    struct Command {
+        // Applies the command and destroys it.
+        void (*apply)(World *world, Command *command);
+
+        // Destroys a command that is not applied, null if there is
+        // nothing to destroy.
+        void (*discard)(Command *command);
+
+        Command *next;
+        Entity entity;
+    };
+
+    template <typename Component>
+    struct PackCommand : Command {
+        Component component;
+
+        template <typename T>
+        explicit PackCommand(T &&component)
+            : component(std::forward<T>(component)) {}
+    };
+
+    struct Block {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+
+    World *world;
+
+    // Commands in the order they were recorded.
+    Command *head = nullptr;
+    Command *tail = nullptr;
+
+    std::vector<Block> blocks;
+
+    // The block commands are written to and the bytes used in it.
+    size_t block = 0;
+    size_t used = 0;
+
+    // Returns memory for a command, blocks are never moved so commands
+    // stay where they are until the buffer is cleared.
+    inline void *allocate(size_t size, size_t align);
+
+    // Appends a command to the list of commands.
+    inline void append(Command *command, Entity entity,
+                       void (*apply)(World *, Command *),
+                       void (*discard)(Command *));
+
+    // Applies the commands in the order they were recorded and clears
+    // the buffer.
+    inline void playback(World *world);
+
+    inline void reset();
+
+    template <typename Component>
+    static void apply_pack(World *world, Command *command);
+
+    template <typename Component>
+    static void discard_pack(Command *command);
+
+    template <typename Component>
+    static void apply_remove(World *world, Command *command);
+
+    static inline void apply_destroy(World *world, Command *command);
+};
+
+// A world holds a collection of systems, components and entities.
+class World {
+public:
+    World() = default;
+
+    World(const World &) = delete;
+    World &operator=(const World &) = delete;
+
+    World(World &&) = default;
+    World &operator=(World &&) = default;
+
+    virtual ~World() = default;
+
+    // Called before the first frame when the world is created.
+    virtual void load();
+
+    // Called once per per frame after all events have been handled and
+    // before draw.
+    //
+    // > Systems are not updated on their own, you should call update
+    // on systems here. Note that you should not call `draw()` on
+    // each system since that is handled in the main loop.
+    virtual void update(float dt);
+
+    // Called before a world is unloaded.
+    //
+    // > Note: When overriding this function you need to call unload
+    // on each system and free them.
+    virtual void unload();
+
+    // Creates a new entity in the world with an Active component.
+    Entity make_entity();
+
+    // Creates a new entity and copies components from another, see
+    // `copy_entity`.
+    Entity make_entity(Entity archetype);
+
+    // Creates a new inactive entity in the world. The entity will need
+    // to have active set before it can be used by systems.
+    // Useful to create entities without initializing them.
+    // > Note: Inactive entities still exist in the world and can have
+    // components added to them.
+    Entity make_inactive_entity();
+
+    // Copy components from entity `src` to entity `dst`. Components that
+    // are not copy constructible and copy assignable are not copied.
+    void copy_entity(Entity dst, Entity src);
+
+    // Destroys an entity and all of its components.
+    void destroy_entity(Entity entity);
+
+    // Returns the entity mask, which is empty for ids that were never
+    // created such as `NullEntity` or ids from `reserve_entity`.
+    inline const EntityMask &get_mask(Entity entity) const;
+
+    // Adds or replaces a component and associates an entity with the
+    // component.
+    //
+    // Adding components will invalidate the cache. The number of cached views
+    // is *usually* approximately equal to the number of systems, so this
+    // operation is not that expensive but you should avoid doing it every
+    // frame. This does not apply to 're-packing' components (see note below).
+    //
+    // > Note: If the entity already has a component of the same type, the old
+    // component will be replaced. Replacing a component with a new instance
+    // is *much* faster than calling `remove` and then `pack` which
+    // would result in the cache being rebuilt twice. Replacing a component
+    // does not invalidate the cache and is cheap operation.
+    template <typename Component>
+    ComponentRef<Component> pack(Entity entity, const Component &component);
+
+    // Same as `pack(entity, component)` but moves the component into the
+    // component array instead of copying it.
+    template <typename Component, typename Enable = typename std::enable_if<
+        !std::is_reference<Component>::value>::type>
+    ComponentRef<Component> pack(Entity entity, Component &&component);
+
+    // Constructs a component in place from `args` and associates an entity
+    // with the component. This invalidates the cache in the same way as
+    // `pack`, but avoids constructing a temporary component that is then
+    // copied or moved into the component array.
+    //
+    //     world.emplace<Inventory>(entity, capacity);
+    //
+    // > Aggregate types without a matching constructor are initialized with
+    // `Component{args...}`, which does create a temporary.
+    template <typename Component, typename... Args>
+    ComponentRef<Component> emplace(Entity entity, Args &&...args);
+
+    // Shortcut to pack multiple components to an entity, equivalent to
+    // calling `pack(entity, component)` for each component.
+    //
+    // Unlike the original `pack` function, this function does not return a
+    // reference to the component that was just packed.
+    template <typename C0, typename C1, typename... Cn>
+    void pack(Entity entity, C0 &&c0, C1 &&c1, Cn &&...components);
+
+    // Returns a component of the given type associated with an entity.
+    // This function will only check if the component does not exist for an
+    // entity if assertions are enabled, otherwise it is unchecked.
+    // Use contains if you need to verify the existence of a component
+    // before removing it. This is a cheap operation.
+    //
+    // This function returns a reference to a component in the packed array.
+    // The reference may become invalid after `remove` is called since `remove`
+    // may move components in memory.
+    //
+    //     auto &a = world.unpack<A>(entity1);
+    //     a.x = 5; // a is a valid reference and x will be updated.
+    //
+    //     auto b = world.unpack<B>(entity1); // copy B
+    //     world.remove<B>(entity2);
+    //     b.x = 5;
+    //     world.pack(entity1, b); // Ensures b will be updated in the array
+    //
+    //     auto &c = world.unpack<C>(entity1);
+    //     world.remove<C>(entity2);
+    //     c.x = 5; // may not update c.x in the array
+    //
+    // If you plan on holding the reference it is better to copy the
+    // component and then pack it again if you have modified the component.
+    // Re-packing a component is a cheap operation and will not invalidate.
+    // the cache.
+    //
+    // > Do not store this reference between frames such as in a member
+    // variable, store the entity instead and call unpack each frame. This
+    // operation is designed to be called multiple times per frame so it
+    // is very fast, there is no need to `cache` a component reference in
+    // a member variable.
+    template <typename Component>
+    inline ComponentRef<Component> unpack(Entity entity);
+
+    // Returns true if a component of the given type is associated with an
+    // entity. This is a cheap operation.
+    template <typename Component>
+    inline bool contains(Entity entity) const;
+
+    // Returns true if an entity contains all given components.
+    template <typename C0, typename... Cn,
+        typename Enable = typename std::enable_if<(sizeof...(Cn) > 0)>::type>
+    inline bool contains(Entity entity) const;
+
+    // Removes a component from an entity. Removing components invalidates
+    // the cache.
+    //
+    // If the entity does not have the component being removed this function
+    // is a noop and will succeed.
+    template <typename Component>
+    void remove(Entity entity);
+
+    // Adds or removes an Active component.
+    //
+    // > When calling `set_active(entity, true)` with an entity that is already
+    // active this function won't do anything. The same is true when calling
+    // `set_active(entity, false)` with an entity that is already inactive.
+    inline void set_active(Entity entity, bool active);
+
+    // Returns all entities that have all requested components. By default
+    // only entities with an `Active` component are matched unless
+    // `include_inactive` is true.
+    //
+    //     for (auto entity : view<A, B, C>()) {
+    //         auto &a = unpack<A>(entity);
+    //         // ...
+    //     }
+    //
+    // The first call to this function will build a cache with the entities
+    // that contain the requested components, subsequent calls will return
+    // the cached data as long as the data is still valid. If a cache is no
+    // longer valid, this function will rebuild the cache by applying all
+    // necessary diffs to make the cache valid.
+    //
+    // The cost of rebuilding the cache depends on how many diff operations
+    // are needed. Any operation that changes whether an entity should be
+    // in this cache (does the entity have all requested components?) counts
+    // as a single Add or Remove diff. Functions like `remove`,
+    // `make_entity`, `pack`, `destroy_entity` may cause a cache to be
+    // invalidated. Functions that may invalidate the cache are documented.
+    template <typename... Components>
+    const std::vector<Entity> &view(bool include_inactive = false);
+
+    // Same as `view<Components...>()` but entities that have any of the
+    // `Excluded` components are not matched.
+    //
+    //     for (auto entity : view<A, B>(exclude<C, D>())) {
+    //         // entity has A and B but neither C nor D
+    //     }
+    //
+    // Views with exclusions are cached like any other view.
+    template <typename... Components, typename... Excluded>
+    const std::vector<Entity> &view(Exclude<Excluded...>,
+                                    bool include_inactive = false);
+
+    // Returns a persistent handle to the entities that have all requested
+    // components. The handle resolves the view cache and component arrays
+    // once, so using it every frame skips building a mask and looking up
+    // the cache like `view()` does. Obtain the handle once, usually in
+    // `System::load`, and keep it for as long as the world exists.
+    //
+    //     View<A, B> ab = world->make_view<A, B>();
+    //     // ...
+    //     for (auto entity : ab) {
+    //         auto &a = ab.unpack<A>(entity);
+    //         // ...
+    //     }
+    //
+    // The same notes about cache invalidation in `view` apply here.
+    template <typename... Components>
+    View<Components...> make_view(bool include_inactive = false);
+
+    // Same as `make_view<Components...>()` but entities that have any of
+    // the `Excluded` components are not matched.
+    template <typename... Components, typename... Excluded>
+    View<Components...> make_view(Exclude<Excluded...>,
+                                  bool include_inactive = false);
+
+#ifndef TWO_STORAGE_ARCHETYPE
+    // Returns a handle to an owning group. A group owns the component
+    // arrays of its components and keeps the components of every entity
+    // with all requested components at the front of each array, in the
+    // same order. Iterating a group walks the arrays in lockstep without
+    // any lookups.
+    //
+    //     auto particles = group<Transform, Particle>();
+    //     particles.each([](Transform &tf, Particle &p) {
+    //         // ...
+    //     });
+    //
+    // A component can only be owned by one group. Calling this again with
+    // the same components returns a handle to the same group. If any of
+    // the components is owned by a different group an empty group is
+    // returned, which must be checked before the group is used:
+    //
+    //     auto particles = group<Transform, Particle>();
+    //     if (!particles) { /* Transform or Particle is already owned */ }
+    //
+    // Groups make packing and removing their components slower.
+    template <typename... Components>
+    Group<Components...> group(bool include_inactive = false);
+#endif
+
+    // Calls `fn` with a reference to each unpacked component for every entity
+    // with all requested components. If `fn` takes an `Entity` as its first
+    // parameter it is also called with the entity. Entities are not visited
+    // in any particular order.
+    //
+    //     each<A, B, C>([](A &a, B &b, C &c) {
+    //         // ...
+    //     });
+    //
+    //     each<A, B, C>([](Entity entity, A &a, B &b, C &c) {
+    //         // ...
+    //     });
+    //
+    // `fn` may be any callable. It is not wrapped in a `std::function`, so
+    // a lambda passed to this function can be inlined into the loop.
+    //
+    // If every entity with one of the requested components is in the view,
+    // the packed array of that component is iterated directly. This is
+    // always the case when unpacking a single component and all entities
+    // with that component are active.
+    //
+    // This function calls `view<Components...>()` internally so the same
+    // notes about `view` apply here as well.
+    template <typename... Components, typename Func>
+    inline void each(Func &&fn, bool include_inactive = false);
+
+    // Same as `each<Components...>(fn)` but entities that have any of the
+    // `Excluded` components are skipped.
+    //
+    //     each<A, B>([](A &a, B &b) {
+    //         // ...
+    //     }, exclude<C>());
+    template <typename... Components, typename Func, typename... Excluded>
+    inline void each(Func &&fn, Exclude<Excluded...>,
+                     bool include_inactive = false);
+
+    // Calls `fn(count, Components *...)` with pointers to contiguous runs
+    // of `count` components, where index `i` of every array belongs to the
+    // same entity. The loop over each run has no lookups, so it can be
+    // vectorized by the compiler.
+    //
+    //     each_chunk<Position, Velocity>(
+    //         [dt](size_t n, Position *p, Velocity *v) {
+    //             for (size_t i = 0; i < n; ++i) p[i].x += v[i].x * dt;
+    //         });
+    //
+    // Without TWO_STORAGE_ARCHETYPE runs come from the group made with
+    // `group<Components...>()`, which must be created beforehand. Without
+    // a group `fn` is called once per entity with a `count` of 1. With
+    // TWO_STORAGE_ARCHETYPE `fn` is called once per matching table.
+    //
+    // Components must not be added or removed while inside `fn`.
+    template <typename... Components, typename Func>
+    void each_chunk(Func &&fn, bool include_inactive = false);
+
+    // Same as `each<Components...>(fn)` but the entities are split into
+    // ranges that are run on the thread pool, see `set_thread_pool`. The
+    // calling thread blocks until every range has finished.
+    //
+    //     par_each<Transform, Particle>([dt](Transform &tf, Particle &p) {
+    //         tf.position += p.velocity * dt;
+    //     });
+    //
+    // `fn` is called from several threads at the same time. It may read
+    // and write the components it is passed and call `unpack`, `contains`
+    // and `get_mask`. Components must not be added or removed and entities
+    // must not be created or destroyed until `par_each` returns, record
+    // them with `commands()` instead.
+    template <typename... Components, typename Func>
+    void par_each(Func &&fn, bool include_inactive = false);
+
+    // Sets the thread pool used by `par_each`. The pool is not owned by the
+    // world and must outlive it, or be replaced first. If no pool is set,
+    // the world creates its own pool with one thread per hardware thread
+    // the first time `par_each` is called.
+    inline void set_thread_pool(ThreadPool *pool);
+
+    // Returns the thread pool used by `par_each`, creating the default pool
+    // if none was set. Systems may use the pool to schedule their own jobs.
+    inline ThreadPool *get_thread_pool();
+
+    // Calls `fn` once with the number of components of a type stored as a
+    // structure of arrays and a pointer to each of its field arrays, in
+    // the order listed in its `SoaLayout`. Every component is visited,
+    // including components of inactive entities.
+    //
+    //     each_fields<Position>([dt](size_t n, float *x, float *y) {
+    //         for (size_t i = 0; i < n; ++i) x[i] += dt;
+    //     });
+    template <typename Component, typename Func>
+    void each_fields(Func &&fn);
+
+    // Returns an entity that contains all components requested. Removing
+    // an entity from a view moves the last entity of the view into its
+    // place, so the order is not kept and `view_one()` may return any
+    // matching entity once entities were removed from the view.
+    //
+    // The returned optional will have no value if no entities exist with
+    // all requested components.
+    template <typename... Components>
+    Optional<Entity> view_one(bool include_inactive = false);
+
+    // Finds an entity with the requested component, see `view_one()`,
+    // and unpacks the component requested. This is convenience function
+    // for getting at a single component in a single entity.
+    //
+    //     auto camera = world.unpack_one<Camera>();
+    //
+    //     // is equivalent to
+    //     auto entity = world.view_one<Camera>().value();
+    //     auto camera = world.unpack<Camera>(entity);
+    //
+    // Unlike `view_one()` this function will panic if no entities with
+    // the requested component were matched. Only use this function if not
+    // matching any entity should be an error, if not use `view_one()`
+    // instead.
+    template <typename Component>
+    ComponentRef<Component> unpack_one(bool include_inactive = false);
+
+    // Returns all entities in the world. Entities returned may be inactive.
+    // > Note: Calling `destroy_entity()` will invalidate the iterator, use
+    // `view<>(true)` to get all entities without having `destroy_entity()`
+    // invalidate the iterator.
+    inline const std::vector<Entity> &unsafe_view_all() { return entities; }
+
+    // Creates and adds a system to the world. This function calls
+    // `System::load` to initialize the system.
+    //
+    // > Systems are not unique. 'Duplicate' systems, that is different
+    // instances of the same system type, are allowed in the world.
+    template <class T, typename... Args>
+    T *make_system(Args &&...args);
+
+    // Adds a system to the world. This function calls `System::load` to
+    // initialize the system.
+    //
+    // > You may add multiple different instances of the same system type,
+    // but passing a system pointer that points to an instance that is
+    // already in the world is not allowed and will not be checked by default.
+    // Enable `TWO_PARANOIA` to check for duplicate pointers.
+    template <class T>
+    T *make_system(T *system);
+
+    // Adds a system to the world before another system if it exists.
+    // `Before` is an existing system.
+    // `T` is the system to be added before an existing system.
+    template <class Before, class T, typename... Args>
+    T *make_system_before(Args &&...args);
+
+    // Returns the first system that matches the given type.
+    // System returned will be `nullptr` if it is not found.
+    template <class T>
+    T *get_system();
+
+    // Returns all system that matches the given type.
+    // Systems returned will not be null.
+    template <class T>
+    void get_all_systems(std::vector<T *> *systems);
+
+    // System must not be null. Do not destroy a system while the main update
+    // loop is running as it could invalidate the system iterator, consider
+    // checking if the system should run or not in the system update loop
+    // instead.
+    void destroy_system(System *system);
+
+    // Destroy all systems in the world.
+    void destroy_systems();
+
+    // Systems returned will not be null.
+    inline const std::vector<System *> &systems() { return active_systems; }
+
+    // Schedules a job on the thread pool for the `update` of each system
+    // and returns a job that finishes once all systems have updated. A
+    // system waits for the systems registered before it whose `access()`
+    // conflicts with its own, other systems may update at the same time.
+    //
+    //     void update(float dt) override {
+    //         get_thread_pool()->wait(schedule_systems(dt));
+    //     }
+    //
+    // Systems that are not exclusive must not make structural changes, they
+    // may record them with `commands()` instead. The components they use
+    // must already be registered. The world must not be changed outside of
+    // the systems until the job finishes.
+    inline Job schedule_systems(float dt, const Job &parent = Job());
+
+    // Returns the command buffer of the calling thread. Each thread of the
+    // thread pool has its own buffer, threads that are not part of the
+    // pool share the buffer of the thread that plays back the commands.
+    // Buffers are not synchronized, so only one thread outside the pool may
+    // record commands at a time, usually the thread that plays them back.
+    // Workers of other pools must not call this.
+    //
+    //     world->par_each<Health>([world](Entity entity, Health &health) {
+    //         if (health.value <= 0) world->commands().destroy_entity(entity);
+    //     });
+    //     world->playback_commands();
+    inline CommandBuffer &commands();
+
+    // Applies the commands in the buffer of each thread, in the order of
+    // the threads in the pool, and clears the buffers. The commands of a
+    // buffer are applied in the order they were recorded. Jobs may run on
+    // any thread, so use separate buffers and `playback(buffer)` if the
+    // order of commands across jobs matters.
+    //
+    // Commands for entities that are no longer alive, such as entities
+    // destroyed by an earlier command in any buffer, are skipped. Caches
+    // are updated once for each entity that was changed, after every
+    // command has been applied. Must not be called while running in
+    // parallel.
+    inline void playback_commands();
+
+    // Same as `playback_commands` for a single buffer made for this world.
+    inline void playback(CommandBuffer &buffer);
+
+    // Returns a new entity id without creating the entity, so entities can
+    // be made from any thread while the world is read in parallel. The
+    // entity is added to the world, inactive and without components, the
+    // next time commands are played back or an entity is made. Until then
+    // the entity may only be used with command buffers, and `contains` and
+    // `get_mask` report that it has no components.
+    //
+    // Must not be called at the same time as a structural change.
+    inline Entity reserve_entity();
+
+    // Adds a function to receive events of type T
+    template <typename Event>
+    void bind(typename EventChannel<Event>::EventHandler &&fn);
+
+    // Same as `bind(fn)` but allows a member function to be used
+    // as an event handler.
+    //
+    //     bind<KeyDownEvent>(&World::keydown, this);
+    template <typename Event, typename Func, class T>
+    void bind(Func &&fn, T this_ptr);
+
+    // Emits an event to all event handlers. If a handler function in the
+    // chain returns true then the event is considered handled and will
+    // not propagate to other listeners.
+    template <typename Event>
+    void emit(const Event &event) const;
+
+    // Adds a function to receive all events of type T queued with
+    // `enqueue` at once, as `fn(count, events)`.
+    template <typename Event>
+    void bind_batch(typename EventChannel<Event>::BatchHandler &&fn);
+
+    // Queues an event to be delivered by `dispatch_events`. May be called
+    // from jobs on the thread pool at the same time, each thread has its
+    // own queue. Threads that are not part of the pool share one queue, so
+    // only one of them may queue events at a time, and workers of other
+    // pools must not call this. Events are dropped if there are no
+    // handlers for their type, so handlers must be bound before events are
+    // queued.
+    template <typename Event>
+    void enqueue(Event &&event);
+
+    // Delivers the events queued with `enqueue`. Each handler is called
+    // for all queued events of a type in one loop, and events a handler
+    // returns true for are not passed to later handlers. Batch handlers
+    // then receive the events that were not handled. Events are queued
+    // in thread order and in the order they were queued on each thread.
+    //
+    // Events queued by handlers are delivered on the next call. Must not
+    // be called from a handler or while events are being queued.
+    inline void dispatch_events();
+
+    // Removes all event handlers, you'll unlikely need to call this since
+    // events are cleared when the world is destroyed.
+    inline void clear_event_channels() { channels.clear(); };
+
+    // Components will be registered on their own if a new type of component is
+    // added to an entity. There is no need to call this function unless you
+    // are doing something specific that requires it.
+    template <typename Component>
+    void register_component();
+
+    // Registers a component type if it does not exist and returns it.
+    // Components are registered automatically so there is usually no reason
+    // to call this function.
+    template <typename Component>
+    inline ComponentType find_or_register_component();
+
+    // Recycles entity ids so that they can be safely reused. This function
+    // exists to ensure we don't reuse entity ids that are still present in
+    // some cache even though the entity has been destroyed. This can happen
+    // since cache operations are done in a 'lazy' manner.
+    // This function should be called at the end of each frame.
+    void collect_unused_entities();
+
+private:
+    friend class CommandBuffer;
+
+    template <typename... Components>
+    friend class View;
+
+    template <typename... Components>
+    friend class Group;
+
+    // An owning group, see `group`. Entities with all components in
+    // `mask` are in the group and the components of the group's entities
+    // are the first `size` components in each owned array.
+    struct GroupData {
+        EntityMask mask;
+        size_t size;
+
+        // Returns the index of an entity in the first owned array.
+        size_t (*index_of)(World *world, Entity entity);
+
+        // Swaps an entity with the entity at `index` in every owned array.
+        void (*swap)(World *world, Entity entity, size_t index);
+    };
+
+    // Identifies a view, entities match if they have all `include`
+    // components and none of the `exclude` components.
+    struct ViewMask {
+        EntityMask include;
+        EntityMask exclude;
+
+        bool matches(const EntityMask &mask) const {
+            return (mask & include) == include && (mask & exclude).none();
+        }
+
+        bool operator==(const ViewMask &other) const {
+            return include == other.include && exclude == other.exclude;
+        }
+    };
+
+    struct ViewMaskHash {
+        size_t operator()(const ViewMask &mask) const {
+            auto h = std::hash<EntityMask>()(mask.include);
+            return h ^ (std::hash<EntityMask>()(mask.exclude)
+                        + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
+
+    // Used to speed up entity lookups
+    struct EntityCache {
+        struct Diff {
+            enum Operation { Add, Remove };
+            Entity entity;
+            Operation op;
+        };
+        std::vector<Entity> entities;
+        std::vector<Diff> diffs;
+
+        // Entities that will be in the cache once all diffs are applied,
+        // indexed by entity index. Storing the full entity id means a
+        // destroyed entity won't match a new entity that reuses its index.
+        internal::SparseArray<Entity, NullEntity> lookup;
+
+        // Maps an entity index to its position in `entities`.
+        internal::SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> positions;
+
+        // Returns true if the entity will be in the cache once all diffs
+        // are applied.
+        bool contains(Entity entity) const {
+            return lookup.get(entity_index(entity)) == entity;
+        }
+
+#ifdef TWO_STORAGE_ARCHETYPE
+        ViewMask mask;
+
+        // Tables with entities that match the view, see `match_tables`.
+        std::vector<internal::Archetype *> tables;
+        size_t tables_seen = 0;
+#endif
+    };
+
+    struct DestroyedEntity {
+        Entity entity;
+        // Caches that needs to be rebuilt before the entity can be reused
+        std::vector<EntityCache *> caches;
+    };
+
+    size_t alive_count = 0;
+
+    // Systems cannot outlive World.
+    std::vector<System *> active_systems;
+
+    // Kept separate since most of the time we just want to iterate through
+    // all the systems and do not need to know their types.
+    std::vector<type_id_t> active_system_types;
+
+    // Contains available entity ids. When creating entities check if this
+    // is not empty, otherwise use alive_count + 1 as the new id.
+    std::vector<Entity> unused_entities;
+
+    // Contains available entity ids that may still be present in
+    // some cache. Calling `collect_unused_entities()` will remove the
+    // entity from the caches so that the entity can be reused.
+    std::vector<DestroyedEntity> destroyed_entities;
+
+    // All alive (but not necessarily active) entities.
+    std::vector<Entity> entities;
+
+    // Maps an entity index to its position in `entities`.
+    internal::SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> entity_slots;
+
+    std::unordered_map<ViewMask, EntityCache, ViewMaskHash> view_cache;
+
+    // Index with `component_index<Component>()`
+    std::array<std::unique_ptr<IComponentArray>, TWO_COMPONENT_MAX> components;
+
+    // Masks for all entities, indexed by entity index. A page is allocated
+    // when the first entity index within it is created, and pages are never
+    // moved, so references to a mask stay valid.
+    std::vector<std::unique_ptr<EntityMask[]>> mask_pages;
+
+    // Returns the mask of an entity that was added with `add_entity`.
+    inline EntityMask &mask_of(Entity entity);
+
+    // Event channels.
+    std::unordered_map<type_id_t, std::unique_ptr<IEventChannel>> channels;
+
+    // Returns the channel of an event type, creating it if needed.
+    template <typename Event>
+    EventChannel<Event> *find_or_make_channel();
+
+    // Returns the channel of an event type or null if no handlers were
+    // bound.
+    template <typename Event>
+    EventChannel<Event> *find_channel() const;
+
+    std::vector<std::unique_ptr<GroupData>> groups;
+
+    // Components owned by a group.
+    EntityMask owned_components;
+
+    // Pool used by `par_each`, either set by the user or `owned_pool`.
+    ThreadPool *thread_pool = nullptr;
+    std::unique_ptr<ThreadPool> owned_pool;
+
+    // Number of `par_each` calls and systems running in parallel.
+    // Structural changes are not allowed since other threads are reading
+    // the caches and components.
+    internal::MovableCounter parallel_sections;
+
+    // Guards `view_cache` while `parallel_sections` is not zero, since
+    // systems updating at the same time may create new views.
+    internal::MovableMutex cache_mutex;
+
+    // One command buffer per thread of `thread_pool`, see `commands`.
+    std::vector<std::unique_ptr<CommandBuffer>> thread_commands;
+
+    // Ids returned by `reserve_entity` that have not been added to
+    // `entities` yet. `reserved_unused` ids were taken from the back of
+    // `unused_entities`, and may be larger than the number of unused ids.
+    // `reserved_new` ids are new indices starting at `alive_count`.
+    internal::MovableAtomic<size_t> reserved_unused;
+    internal::MovableAtomic<size_t> reserved_new;
+
+    // While commands are played back caches are not updated, instead the
+    // bits that changed are collected for each entity. `batched_slots`
+    // maps an entity index to its position in `batched_changes`.
+    bool batching = false;
+    std::vector<std::pair<Entity, EntityMask>> batched_changes;
+    internal::SparseArray<TWO_ENTITY_INT_TYPE, InvalidIndex> batched_slots;
+
+    // Adds an entity id to `entities`.
+    inline void add_entity(Entity entity);
+
+    // Adds the entities returned by `reserve_entity` to the world.
+    inline void add_reserved_entities();
+
+    inline void begin_playback();
+
+    // Returns true if the entity was created and has not been destroyed.
+    inline bool alive(Entity entity) const;
+
+    // Updates the caches of each entity changed during playback.
+    inline void end_playback();
+
+    // Applies the pending changes to every cache, so views can be read from
+    // several threads without changing the caches.
+    inline void flush_caches();
+
+    // Adds or removes an entity from the groups after the `changed` bits
+    // in its entity mask were updated. This must be called before any
+    // component is removed from its component array.
+    void update_groups(Entity entity, const EntityMask &changed);
+
+    // Returns the group that matches `mask` or null if there is none.
+    inline GroupData *find_group(const EntityMask &mask);
+
+    template <typename Component>
+    static size_t group_index_of(World *world, Entity entity);
+
+    template <typename... Components>
+    static void group_swap(World *world, Entity entity, size_t index);
+
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Allocated separately so that component arrays can keep a pointer to
+    // the tables when the world is moved.
+    std::unique_ptr<internal::ArchetypeStore> archetypes{
+        new internal::ArchetypeStore};
+
+    // Adds tables created since the last call to the tables of a cache,
+    // and returns the tables that match the view.
+    const std::vector<internal::Archetype *> &match_tables(
+        EntityCache *cache);
+#endif
+
+    // Runs `par_each` over the entities of the view instead of tables.
+    template <typename... Components, typename Func>
+    void par_each_entities(Func &fn, bool include_inactive,
+                           internal::StoragePtrs<Components...> &arrays);
+
+    // Returns the mask matched by `view<Components...>()`. `Maybe`
+    // components are registered but not included in the mask.
+    template <typename... Components>
+    ViewMask view_mask(bool include_inactive);
+
+    // Returns the mask matched by `view<Components...>(exclude<Excluded>())`.
+    template <typename... Components, typename... Excluded>
+    ViewMask view_mask(Exclude<Excluded...>, bool include_inactive);
+
+    // Sets a component bit in the entity mask after a component was packed
+    // and updates the caches.
+    void set_mask_bit(Entity entity, ComponentType type);
+
+    // Adds or removes an entity from the caches after the `changed` bits
+    // in its entity mask were updated.
+    void update_caches(Entity entity, const EntityMask &changed);
+
+    // Returns the cache for a mask, building it if it does not exist.
+    EntityCache *find_or_make_cache(const ViewMask &mask);
+
+    // Returns the entities in the cache for a mask, applying any diffs.
+    const std::vector<Entity> &view_entities(const ViewMask &mask);
+
+    // Returns the storage of a component requested by a view, the
+    // component must already be registered.
+    template <typename Component>
+    internal::StorageOf<Component> *view_storage();
+
+    void apply_diffs_to_cache(EntityCache *cache);
+    void invalidate_cache(EntityCache *cache, EntityCache::Diff &&diff);
+};
+
+// A persistent handle to a cached view, see `World::make_view`. A default
+// constructed view is empty and must be assigned before it is used.
+//
+// > A view is only valid for the lifetime of the world that created it,
+// and is invalidated if that world is moved.
+template <typename... Components>
+class View {
+public:
+    View() = default;
+
+    // Returns all entities that have all requested components, applying
+    // any pending changes to the cache first.
+    inline const std::vector<Entity> &entities();
+
+    std::vector<Entity>::const_iterator begin() { return entities().begin(); }
+    std::vector<Entity>::const_iterator end() { return entities().end(); }
+
+    size_t size() { return entities().size(); }
+
+    // Same as `World::unpack` but uses the component array resolved when
+    // the view was created. `Component` must be one of the view components.
+    template <typename Component>
+    inline ComponentRef<Component> unpack(Entity entity);
+
+    // Same as `World::each` for the entities in this view.
+    template <typename Func>
+    inline void each(Func &&fn);
+
+private:
+    friend class World;
+
+    World *world = nullptr;
+    World::EntityCache *cache = nullptr;
+    internal::StoragePtrs<Components...> arrays;
+
+    View(World *world, World::EntityCache *cache,
+         internal::StorageOf<Components> *...arrays)
+        : world{world}, cache{cache}, arrays{arrays...} {}
+};
+
+// A handle to an owning group, see `World::group`. A default constructed
+// group is empty and must be assigned before it is used.
+//
+// > A group is only valid for the lifetime of the world that created it.
+template <typename... Components>
+class Group {
+public:
+    static_assert(internal::AllPacked<Components...>::value,
+                  "Groups cannot own tags, Maybe or structure of arrays "
+                  "components");
+
+    Group() = default;
+
+    // Returns false if the group is empty, such as a group returned by
+    // `World::group` when one of its components is owned by another group.
+    explicit operator bool() const { return group != nullptr; }
+
+    // Returns the number of entities in the group.
+    size_t size() const { return group != nullptr ? group->size : 0; }
+
+    // Returns the entities in the group. The entity at index `i` owns the
+    // component at index `i` in `data<Component>()` for every component.
+    inline const Entity *entities() const;
+
+    // Returns the packed array of a group component, only the first
+    // `size()` components belong to the group.
+    template <typename Component>
+    inline Component *data();
+
+    // Same as `World::each` for the entities in this group. The components
+    // are read from the same index in each array so no lookups are needed.
+    template <typename Func>
+    inline void each(Func &&fn);
+
+    // Calls `fn(size(), data<Components>()...)` once if the group is not
+    // empty, see `World::each_chunk`.
+    template <typename Func>
+    inline void each_chunk(Func &&fn);
+
+private:
+    friend class World;
+
+    World::GroupData *group = nullptr;
+    internal::StoragePtrs<Components...> arrays;
+
+    Group(World::GroupData *group, ComponentStorage<Components> *...arrays)
+        : group{group}, arrays{arrays...} {}
+};
+
+inline const EntityMask &World::get_mask(Entity entity) const {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    static const EntityMask empty;
+    auto index = entity_index(entity);
+    auto page = index / PageSize;
+    if (page >= mask_pages.size() || mask_pages[page] == nullptr) {
+        return empty;
+    }
+    return mask_pages[page][index & (PageSize - 1)];
+}
+
+inline EntityMask &World::mask_of(Entity entity) {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto index = entity_index(entity);
+    ASSERT(index / PageSize < mask_pages.size()
+           && mask_pages[index / PageSize] != nullptr);
+    return mask_pages[index / PageSize][index & (PageSize - 1)];
+}
+
+template <typename Component>
+ComponentRef<Component> World::pack(Entity entity, const Component &component) {
+    ASSERT_ENTITY(entity);
+    // Component may not have been regisered yet
+    auto type = find_or_register_component<Component>();
+    auto *a =
+        static_cast<ComponentStorage<Component> *>(components[type].get());
+    auto &&new_component = a->write(entity, component);
+    set_mask_bit(entity, type);
+    return new_component;
+}
+
+template <typename Component, typename Enable>
+ComponentRef<Component> World::pack(Entity entity, Component &&component) {
+    ASSERT_ENTITY(entity);
+    auto type = find_or_register_component<Component>();
+    auto *a =
+        static_cast<ComponentStorage<Component> *>(components[type].get());
+    auto &&new_component = a->write(entity, std::move(component));
+    set_mask_bit(entity, type);
+    return new_component;
+}
+
+template <typename Component, typename... Args>
+ComponentRef<Component> World::emplace(Entity entity, Args &&...args) {
+    ASSERT_ENTITY(entity);
+    auto type = find_or_register_component<Component>();
+    auto *a =
+        static_cast<ComponentStorage<Component> *>(components[type].get());
+    auto &&new_component = a->emplace(entity, std::forward<Args>(args)...);
+    set_mask_bit(entity, type);
+    return new_component;
+}
+
+template <typename C0, typename C1, typename... Cn>
+void World::pack(Entity entity, C0 &&c0, C1 &&c1, Cn &&...components) {
+    pack(entity, std::forward<C0>(c0));
+    pack(entity, std::forward<C1>(c1), std::forward<Cn>(components)...);
+}
+
+inline void World::set_mask_bit(Entity entity, ComponentType type) {
+    auto &mask = mask_of(entity);
+    if (mask.test(type)) {
+        // entity already has a component of this type, the component was
+        // replaced, but since the mask is unchanged there is no need to
+        // rebuild the cache.
+        TWO_MSG("%s is unchanged since entity #%x is unchanged\n",
+                mask.to_string().c_str(), entity);
+        return;
+    }
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+    mask.set(type);
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Components were already moved when the component was written, tags
+    // are only stored in the mask and need to be moved here.
+    archetypes->move(entity, mask);
+#endif
+    update_groups(entity, EntityMask().set(type));
+    update_caches(entity, EntityMask().set(type));
+}
+
+inline void World::update_groups(Entity entity, const EntityMask &changed) {
+    const auto &mask = get_mask(entity);
+    for (auto &group : groups) {
+        if ((group->mask & changed).none()) {
+            continue;
+        }
+        bool match = (mask & group->mask) == group->mask;
+        bool member = group->index_of(this, entity) < group->size;
+        if (match && !member) {
+            group->swap(this, entity, group->size++);
+        } else if (!match && member) {
+            group->swap(this, entity, --group->size);
+        }
+    }
+}
+
+inline void World::update_caches(Entity entity, const EntityMask &changed) {
+    if (batching) {
+        // Commands for the same entity are usually recorded together
+        if (!batched_changes.empty()
+            && batched_changes.back().first == entity) {
+            batched_changes.back().second |= changed;
+            return;
+        }
+        auto index = entity_index(entity);
+        auto slot = batched_slots.get(index);
+        if (slot == InvalidIndex) {
+            batched_slots.set(index, batched_changes.size());
+            batched_changes.emplace_back(entity, changed);
+        } else {
+            batched_changes[slot].second |= changed;
+        }
+        return;
+    }
+    const auto &mask = get_mask(entity);
+    for (auto &cached : view_cache) {
+        const auto &key = cached.first;
+        if (((key.include | key.exclude) & changed).none()) {
+            // None of the components in this view changed
+            continue;
+        }
+        bool match = key.matches(mask);
+        if (match == cached.second.contains(entity)) {
+            // Entity is already in the cache, or was already removed
+            continue;
+        }
+        invalidate_cache(&cached.second, EntityCache::Diff{entity,
+            match ? EntityCache::Diff::Add : EntityCache::Diff::Remove});
+
+        TWO_MSG("%s %s entity #%x\n", key.include.to_string().c_str(),
+                match ? "now includes" : "no longer includes", entity);
+    }
+}
+
+template <typename Component>
+inline ComponentRef<Component> World::unpack(Entity entity) {
+    ASSERT_ENTITY(entity);
+    auto type = component_index<Component>();
+    // Assume component was registered when it was packed
+    ASSERT(components[type] != nullptr);
+    ASSERTS(get_mask(entity).test(type), "Missing component on Entity.");
+
+    auto *a =
+        static_cast<ComponentStorage<Component> *>(components[type].get());
+    return a->read(entity);
+}
+
+template <typename Component>
+inline bool World::contains(Entity entity) const {
+    // This function must work if a component has never been registered,
+    // since it's reasonable to check if an entity has a component when
+    // a component type has never been added to any entity. In that case
+    // the bit is never set in the mask.
+    return get_mask(entity).test(component_index<Component>());
+}
+
+template <typename C0, typename... Cn, typename Enable>
+inline bool World::contains(Entity entity) const {
+    return contains<C0>(entity) && contains<Cn...>(entity);
+}
+
+template <typename Component>
+void World::remove(Entity entity) {
+    auto type = component_index<Component>();
+    // Assume component was registered when it was packed
+    ASSERT(components[type] != nullptr);
+
+    if (!get_mask(entity).test(type)) {
+        // No need to invalidate caches since the entity didn't have
+        // a component of this type.
+        return;
+    }
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+    mask_of(entity).reset(type);
+    update_groups(entity, EntityMask().set(type));
+    components[type]->remove(entity);
+#ifdef TWO_STORAGE_ARCHETYPE
+    archetypes->move(entity, get_mask(entity));
+#endif
+    update_caches(entity, EntityMask().set(type));
+}
+
+inline void World::set_active(Entity entity, bool active) {
+    ASSERT_ENTITY(entity);
+    // If active is constant this conditional should be removed when
+    // the function is inlined
+    if (active)
+        pack(entity, Active{});
+    else
+        remove<Active>(entity);
+}
+
+template <typename... Components>
+const std::vector<Entity> &World::view(bool include_inactive) {
+    return view_entities(view_mask<Components...>(include_inactive));
+}
+
+template <typename... Components, typename... Excluded>
+const std::vector<Entity> &World::view(Exclude<Excluded...> excluded,
+                                       bool include_inactive) {
+    return view_entities(
+        view_mask<Components...>(excluded, include_inactive));
+}
+
+template <typename... Components>
+View<Components...> World::make_view(bool include_inactive) {
+    auto *cache =
+        find_or_make_cache(view_mask<Components...>(include_inactive));
+
+    return View<Components...>(this, cache, view_storage<Components>()...);
+}
+
+template <typename... Components, typename... Excluded>
+View<Components...> World::make_view(Exclude<Excluded...> excluded,
+                                     bool include_inactive) {
+    auto *cache = find_or_make_cache(
+        view_mask<Components...>(excluded, include_inactive));
+
+    return View<Components...>(this, cache, view_storage<Components>()...);
+}
+
+#ifndef TWO_STORAGE_ARCHETYPE
+template <typename... Components>
+Group<Components...> World::group(bool include_inactive) {
+    using First = typename std::tuple_element<
+        0, std::tuple<Components...>>::type;
+
+    auto mask = view_mask<Components...>(include_inactive).include;
+    if (auto *group = find_group(mask)) {
+        return Group<Components...>(group, view_storage<Components>()...);
+    }
+    EntityMask owned;
+    TWO_TEMPLATE_FOLD(owned.set(component_index<Components>()));
+    if ((owned & owned_components).any()) {
+        // Both groups would reorder the same component array
+        TWO_MSG("warn: %s is already owned by another group\n",
+                (owned & owned_components).to_string().c_str());
+        return Group<Components...>();
+    }
+    owned_components |= owned;
+
+    auto *group = new GroupData;
+    group->mask = mask;
+    group->size = 0;
+    group->index_of = &group_index_of<First>;
+    group->swap = &group_swap<Components...>;
+    groups.emplace_back(group);
+
+    // Move the entities that already have all components to the front,
+    // only entities before `i` have been swapped.
+    auto *first = view_storage<First>();
+    for (size_t i = 0; i < first->count(); ++i) {
+        auto entity = first->entities()[i];
+        if ((get_mask(entity) & mask) == mask) {
+            group_swap<Components...>(this, entity, group->size++);
+        }
+    }
+    return Group<Components...>(group, view_storage<Components>()...);
+}
+
+inline World::GroupData *World::find_group(const EntityMask &mask) {
+    for (auto &group : groups) {
+        if (group->mask == mask) {
+            return group.get();
+        }
+    }
+    return nullptr;
+}
+
+template <typename Component>
+size_t World::group_index_of(World *world, Entity entity) {
+    return world->view_storage<Component>()->index_of(entity);
+}
+
+template <typename... Components>
+void World::group_swap(World *world, Entity entity, size_t index) {
+    TWO_TEMPLATE_FOLD(world->view_storage<Components>()->swap(entity, index));
+}
+#endif
+
+template <typename... Components>
+World::ViewMask World::view_mask(bool include_inactive) {
+    ViewMask mask;
+    // Component may not have been registered
+    TWO_TEMPLATE_FOLD(mask.include.set(
+        find_or_register_component<
+            typename internal::StoredType<Components>::type>(),
+        !internal::IsMaybe<Components>::value));
+
+    if (!include_inactive) {
+        mask.include.set(find_or_register_component<Active>());
+    }
+    return mask;
+}
+
+template <typename... Components, typename... Excluded>
+World::ViewMask World::view_mask(Exclude<Excluded...>,
+                                 bool include_inactive) {
+    auto mask = view_mask<Components...>(include_inactive);
+    TWO_TEMPLATE_FOLD(mask.exclude.set(component_index<Excluded>()));
+    return mask;
+}
+
+template <typename Component>
+internal::StorageOf<Component> *World::view_storage() {
+    using T = typename internal::StoredType<Component>::type;
+    return static_cast<ComponentStorage<T> *>(
+        components[component_index<T>()].get());
+}
+
+template <typename... Components, typename Func>
+inline void World::each(Func &&fn, bool include_inactive) {
+#ifdef TWO_STORAGE_ARCHETYPE
+    auto *cache =
+        find_or_make_cache(view_mask<Components...>(include_inactive));
+    internal::StoragePtrs<Components...> arrays{view_storage<Components>()...};
+    // Entities without components are not in any table, so views that
+    // require no components go through the entity cache.
+    if (LIKELY(cache->mask.include.any())) {
+        internal::each_in_tables<Components...>(match_tables(cache), arrays,
+                                                fn);
+        return;
+    }
+    // Only `Maybe` components can be requested here, which have no packed
+    // array to walk.
+    auto &entities = view<Components...>(include_inactive);
+    internal::each_in_range<Components...>(entities, 0, entities.size(),
+                                           arrays, fn);
+#else
+    auto &entities = view<Components...>(include_inactive);
+    internal::StoragePtrs<Components...> arrays{view_storage<Components>()...};
+    internal::each_in_view<Components...>(entities, arrays, fn);
+#endif
+}
+
+template <typename... Components, typename Func, typename... Excluded>
+inline void World::each(Func &&fn, Exclude<Excluded...> excluded,
+                        bool include_inactive) {
+#ifdef TWO_STORAGE_ARCHETYPE
+    auto *cache = find_or_make_cache(
+        view_mask<Components...>(excluded, include_inactive));
+    internal::StoragePtrs<Components...> arrays{view_storage<Components>()...};
+    if (LIKELY(cache->mask.include.any())) {
+        internal::each_in_tables<Components...>(match_tables(cache), arrays,
+                                                fn);
+        return;
+    }
+    auto &entities = view<Components...>(excluded, include_inactive);
+    internal::each_in_range<Components...>(entities, 0, entities.size(),
+                                           arrays, fn);
+#else
+    auto &entities = view<Components...>(excluded, include_inactive);
+    internal::StoragePtrs<Components...> arrays{view_storage<Components>()...};
+    internal::each_in_view<Components...>(entities, arrays, fn);
+#endif
+}
+
+template <typename... Components, typename Func>
+void World::each_chunk(Func &&fn, bool include_inactive) {
+    static_assert(internal::AllPacked<Components...>::value,
+                  "Tags, Maybe and structure of arrays components cannot "
+                  "be iterated in chunks");
+    static_assert(internal::IsCallable<Func &, size_t,
+                                      Components *...>::value,
+                  "Function must take (size_t, Components *...)");
+#ifdef TWO_STORAGE_ARCHETYPE
+    auto *cache =
+        find_or_make_cache(view_mask<Components...>(include_inactive));
+    const auto &tables = match_tables(cache);
+    for (size_t i = 0, count = tables.size(); i < count; ++i) {
+        auto *table = tables[i];
+        if (table->entities.empty()) {
+            continue;
+        }
+        fn(table->entities.size(),
+           table->template column<Components>(component_index<Components>())
+               ->data()...);
+    }
+#else
+    auto mask = view_mask<Components...>(include_inactive).include;
+    if (auto *group = find_group(mask)) {
+        Group<Components...>(group, view_storage<Components>()...)
+            .each_chunk(fn);
+        return;
+    }
+    // The arrays are not in the same order without a group, so each
+    // entity is its own run.
+    each<Components...>([&fn](Components &...components) {
+        fn(1, &components...);
+    }, include_inactive);
+#endif
+}
+
+template <typename... Components, typename Func>
+void World::par_each(Func &&fn, bool include_inactive) {
+    using TakesEntity = internal::EachTakesEntity<Func,
+        typename internal::EachParam<Components>::type...>;
+    static_assert(TakesEntity::value || internal::IsCallable<Func &,
+                      typename internal::EachParam<Components>::type...>::value,
+                  "Function must take (Components &...) or "
+                  "(Entity, Components &...)");
+
+    internal::StoragePtrs<Components...> arrays{view_storage<Components>()...};
+
+#ifdef TWO_STORAGE_ARCHETYPE
+    struct Range {
+        internal::Archetype *table;
+        size_t begin, end;
+    };
+    auto *cache =
+        find_or_make_cache(view_mask<Components...>(include_inactive));
+    // Entities without components are not in any table, see `each`
+    if (UNLIKELY(cache->mask.include.none())) {
+        par_each_entities<Components...>(fn, include_inactive, arrays);
+        return;
+    }
+    const auto &tables = match_tables(cache);
+    auto *pool = get_thread_pool();
+
+    size_t total = 0;
+    for (auto *table : tables) total += table->entities.size();
+    auto range =
+        std::max(internal::ParEachMinRange, total / (pool->size() * 4) + 1);
+
+    std::vector<Range> ranges;
+    for (auto *table : tables) {
+        auto rows = table->entities.size();
+        for (size_t begin = 0; begin < rows; begin += range) {
+            ranges.push_back({table, begin, std::min(rows, begin + range)});
+        }
+    }
+    ++parallel_sections;
+    pool->run(ranges.size(), [&](size_t i) {
+        auto *table = ranges[i].table;
+        internal::each_row_range(TakesEntity(), fn, table->entities,
+            ranges[i].begin, ranges[i].end,
+            internal::RowReader<Components>(table,
+                std::get<internal::IndexOf<Components, Components...>::value>(
+                    arrays))...);
+    });
+    --parallel_sections;
+#else
+    par_each_entities<Components...>(fn, include_inactive, arrays);
+#endif
+}
+
+template <typename... Components, typename Func>
+void World::par_each_entities(Func &fn, bool include_inactive,
+                              internal::StoragePtrs<Components...> &arrays) {
+    auto *pool = get_thread_pool();
+    const auto &entities = view<Components...>(include_inactive);
+    auto range = std::max(internal::ParEachMinRange,
+                          entities.size() / (pool->size() * 4) + 1);
+    auto count = (entities.size() + range - 1) / range;
+
+    ++parallel_sections;
+    pool->run(count, [&](size_t i) {
+        internal::each_in_range<Components...>(entities, i * range,
+            std::min(entities.size(), (i + 1) * range), arrays, fn);
+    });
+    --parallel_sections;
+}
+
+inline void World::set_thread_pool(ThreadPool *pool) {
+    thread_pool = pool;
+    if (pool == nullptr) {
+        return;
+    }
+    while (thread_commands.size() < pool->size()) {
+        thread_commands.emplace_back(new CommandBuffer(this));
+    }
+    for (auto &channel : channels) {
+        channel.second->resize(pool->size());
+    }
+}
+
+inline ThreadPool *World::get_thread_pool() {
+    if (thread_pool == nullptr) {
+        owned_pool.reset(new ThreadPool);
+        set_thread_pool(owned_pool.get());
+    }
+    return thread_pool;
+}
+
+template <typename Component, typename Func>
+void World::each_fields(Func &&fn) {
+    static_assert(internal::IsSoa<Component>(),
+                  "Component must be stored as a structure of arrays");
+    auto type = find_or_register_component<Component>();
+    static_cast<SoaArray<Component> *>(components[type].get())->apply(fn);
+}
+
+template <typename... Components>
+Optional<Entity> World::view_one(bool include_inactive) {
+    auto &v = view<Components...>(include_inactive);
+    if (v.size() > 0) {
+        return v[0];
+    }
+    return {};
+}
+
+template <typename Component>
+ComponentRef<Component> World::unpack_one(bool include_inactive) {
+    auto &v = view<Component>(include_inactive);
+    ASSERTS(v.size() > 0, "No entities were matched");
+    return unpack<Component>(v[0]);
+}
+
+template <class T, typename... Args>
+T *World::make_system(Args &&...args) {
+    return make_system(new T(std::forward<Args>(args)...));
+}
+
+template <class T>
+T *World::make_system(T *system) {
+    static_assert(std::is_convertible<T *, System *>(),
+                  "Type cannot be converted to a System");
+    ASSERTS_PARANOIA(
+        std::find(active_systems.begin(),
+                  active_systems.end(), system) == active_systems.end(),
+        "Duplicate systems in the world");
+
+    active_systems.push_back(system);
+    active_system_types.push_back(type_id<T>());
+    system->load(this);
+    return system;
+}
+
+template <class Before, class T, typename... Args>
+T *World::make_system_before(Args &&...args) {
+    static_assert(std::is_convertible<T *, System *>(),
+                  "Type cannot be converted to a System");
+    ASSERT(active_systems.size() == active_system_types.size());
+
+    auto pos = std::find(active_system_types.begin(),
+                         active_system_types.end(),
+                         type_id<Before>());
+
+    auto *system = new T(std::forward<Args>(args)...);
+    if (pos == active_system_types.end()) {
+        return system;
+    }
+    size_t index = std::distance(pos, active_system_types.end()) - 1;
+    active_systems.insert(active_systems.begin() + index, system);
+    active_system_types.insert(pos, type_id<T>());
+    return system;
+}
+
+template <class T>
+T *World::get_system() {
+    static_assert(std::is_convertible<T *, System *>(),
+                  "Type cannot be converted to a System");
+    ASSERT(active_systems.size() == active_system_types.size());
+
+    auto pos = std::find(active_system_types.begin(),
+                         active_system_types.end(),
+                         type_id<T>());
+
+    if (pos == active_system_types.end()) {
+        return nullptr;
+    }
+    auto index = std::distance(active_system_types.begin(), pos);
+    return static_cast<T *>(active_systems[index]);
+}
+
+template <class T>
+void World::get_all_systems(std::vector<T *> *systems) {
+    static_assert(std::is_convertible<T *, System *>(),
+                  "Type cannot be converted to a System");
+    ASSERT(active_systems.size() == active_system_types.size());
+    ASSERT(systems != nullptr);
+
+    for (size_t i = 0; i < active_systems.size(); ++i) {
+        if (active_system_types[i] != type_id<T>()) {
+            continue;
+        }
+        systems->push_back(static_cast<T *>(active_systems[i]));
+    }
+}
+
+template <typename Component>
+void World::register_component() {
+    auto i = component_index<Component>();
+    // Component must not already exist
+    ASSERT(components[i] == nullptr);
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+
+#ifdef TWO_STORAGE_ARCHETYPE
+    components[i] = std::unique_ptr<ComponentStorage<Component>>(
+        internal::make_storage<Component>(
+            std::is_empty<Component>(), archetypes.get()));
+#else
+    components[i] = std::unique_ptr<ComponentStorage<Component>>(
+        new ComponentStorage<Component>);
+#endif
+}
+
+template <typename Component>
+inline ComponentType World::find_or_register_component() {
+    auto type = component_index<Component>();
+    if (LIKELY(components[type] != nullptr)) {
+        return type;
+    }
+    register_component<Component>();
+    return type;
+}
+
+inline Entity World::make_entity() {
+    auto entity = make_inactive_entity();
+    pack(entity, Active{});
+    return entity;
+}
+
+inline Entity World::make_entity(Entity archetype) {
+    ASSERT_ENTITY(archetype);
+    auto entity = make_entity();
+    copy_entity(entity, archetype);
+    return entity;
+}
+
+inline Entity World::make_inactive_entity() {
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+    add_reserved_entities();
+    Entity entity;
+    if (unused_entities.empty()) {
+        ASSERTS(alive_count < TWO_ENTITY_MAX, "Too many entities");
+        entity = alive_count++;
+
+        // Create a nullentity that will never have any components
+        // This is useful when we need to store entities in an array and
+        // need a way to define entities that are not valid.
+        if (entity == NullEntity) {
+            add_entity(NullEntity);
+            entity = alive_count++;
+        }
+    } else {
+        entity = unused_entities.back();
+        unused_entities.pop_back();
+        auto version = entity_version(entity);
+        auto index = entity_index(entity);
+        entity = entity_id(index, version + 1);
+    }
+    add_entity(entity);
+    return entity;
+}
+
+inline Entity World::reserve_entity() {
+    // `unused_entities` and `alive_count` are not changed until the
+    // reserved entities are added, so only the cursors need to be atomic.
+    auto taken = reserved_unused.fetch_add(1);
+    if (taken < unused_entities.size()) {
+        auto entity = unused_entities[unused_entities.size() - taken - 1];
+        auto version = entity_version(entity);
+        auto index = entity_index(entity);
+        return entity_id(index, version + 1);
+    }
+    for (;;) {
+        auto index = alive_count + reserved_new.fetch_add(1);
+        ASSERTS(index < TWO_ENTITY_MAX, "Too many entities");
+        // The null entity is added along with the reserved entities
+        if (index != NullEntity) {
+            return Entity(index);
+        }
+    }
+}
+
+inline void World::add_reserved_entities() {
+    auto taken = std::min<size_t>(reserved_unused, unused_entities.size());
+    for (size_t i = 0; i < taken; ++i) {
+        auto entity = unused_entities.back();
+        unused_entities.pop_back();
+        auto version = entity_version(entity);
+        auto index = entity_index(entity);
+        add_entity(entity_id(index, version + 1));
+    }
+    size_t count = reserved_new;
+    for (size_t i = 0; i < count; ++i) {
+        add_entity(Entity(alive_count + i));
+    }
+    alive_count += count;
+    reserved_unused.store(0);
+    reserved_new.store(0);
+}
+
+inline void World::add_entity(Entity entity) {
+    auto index = entity_index(entity);
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto page = index / PageSize;
+    if (page >= mask_pages.size()) {
+        mask_pages.resize(page + 1);
+    }
+    if (mask_pages[page] == nullptr) {
+        mask_pages[page].reset(new EntityMask[PageSize]);
+    }
+    entity_slots.set(index, entities.size());
+    entities.push_back(entity);
+}
+
+inline void World::copy_entity(Entity dst, Entity src) {
+    ASSERT_ENTITY(dst);
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+    auto &dst_mask = mask_of(dst);
+    const auto &src_mask = get_mask(src);
+    auto old_mask = dst_mask;
+    for (size_t type = 0; type < components.size(); ++type) {
+        if (!src_mask.test(type)) {
+            continue;
+        }
+        // Components that cannot be copied are left out, so the mask
+        // never has a bit without a component behind it.
+        if (components[type]->copy(dst, src)) {
+            dst_mask.set(type);
+        } else {
+            TWO_MSG("component %zu of entity #%x is not copyable\n",
+                    type, src);
+        }
+    }
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Copied components moved the entity as they were written, tags are
+    // only stored in the mask and need to be moved here.
+    archetypes->move(dst, dst_mask);
+#endif
+    TWO_MSG("copying entity #%x to #%x\n", src, dst);
+    update_groups(dst, old_mask ^ dst_mask);
+    update_caches(dst, old_mask ^ dst_mask);
+}
+
+inline void World::destroy_entity(Entity entity) {
+    ASSERT_ENTITY(entity);
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Removes all components at once
+    archetypes->move(entity, EntityMask());
+#endif
+    auto &mask = mask_of(entity);
+    auto old_mask = mask;
+    mask.reset();
+    update_groups(entity, old_mask);
+
+    for (auto &a : components) {
+        if (a != nullptr) {
+            a->remove(entity);
+        }
+    }
+
+    DestroyedEntity destroyed;
+    destroyed.entity = entity;
+
+    for (auto &cached : view_cache) {
+        if (!cached.second.contains(entity)) {
+            continue;
+        }
+        invalidate_cache(&cached.second,
+            EntityCache::Diff{entity, EntityCache::Diff::Remove});
+
+        // This cache must be rebuilt before the entity can be reused.
+        destroyed.caches.push_back(&cached.second);
+
+        TWO_MSG("%s no longer includes entity #%x (destroyed)\n",
+                cached.first.include.to_string().c_str(), entity);
+    }
+    // Move the last entity into the empty slot
+    auto slot = entity_slots.get(entity_index(entity));
+    ASSERT(slot != InvalidIndex && entities[slot] == entity);
+    auto moved = entities.back();
+    entities[slot] = moved;
+    entity_slots.set(entity_index(moved), slot);
+    entity_slots.set(entity_index(entity), InvalidIndex);
+    entities.pop_back();
+    destroyed_entities.emplace_back(std::move(destroyed));
+}
+
+inline void World::collect_unused_entities() {
+    if (destroyed_entities.size() == 0) {
+        return;
+    }
+    // Reserved ids are taken from the back of the unused entities
+    add_reserved_entities();
+    for (const auto &destroyed : destroyed_entities) {
+        for (auto *cache : destroyed.caches) {
+            // In most cases the cache will have no diffs since if this cache
+            // is viewed every frame by some system it would have been rebuilt
+            // by this point anyway.
+            apply_diffs_to_cache(cache);
+        }
+        // Make entity id available again
+        unused_entities.push_back(destroyed.entity);
+    }
+    destroyed_entities.clear();
+}
+
+inline void World::destroy_system(System *system) {
+    ASSERT(active_systems.size() == active_system_types.size());
+    ASSERT(system != nullptr);
+
+    auto pos = std::find(active_systems.begin(), active_systems.end(), system);
+    if (pos == active_systems.end()) {
+        TWO_MSG("warn: Trying to destroy a system that does not exist\n");
+        return;
+    }
+    system->unload(this);
+    delete system;
+
+    auto index = std::distance(active_systems.begin(), pos);
+    active_systems.erase(pos);
+    active_system_types.erase(active_system_types.begin() + index);
+}
+
+inline void World::destroy_systems() {
+    for (auto *system : active_systems) {
+        system->unload(this);
+        delete system;
+    }
+    active_systems.clear();
+    active_system_types.clear();
+}
+
+inline World::EntityCache *World::find_or_make_cache(const ViewMask &mask) {
+    std::unique_lock<std::mutex> lock(cache_mutex.get(), std::defer_lock);
+    if (UNLIKELY(parallel_sections > 0)) {
+        lock.lock();
+    }
+    auto cache_it = view_cache.find(mask);
+    if (LIKELY(cache_it != view_cache.end())) {
+        TWO_MSG("%s view (%lu) [ops: %lu]\n",
+                mask.include.to_string().c_str(),
+                cache_it->second.entities.size(),
+                cache_it->second.diffs.size());
+
+        return &cache_it->second;
+    }
+    TWO_MSG("%s view (initial cache build)\n",
+            mask.include.to_string().c_str());
+
+    auto &cache = view_cache[mask];
+#ifdef TWO_STORAGE_ARCHETYPE
+    cache.mask = mask;
+#endif
+    for (auto entity : entities) {
+        if (mask.matches(get_mask(entity))) {
+            if (LIKELY(entity != NullEntity)) {
+                cache.positions.set(entity_index(entity),
+                                    cache.entities.size());
+                cache.entities.push_back(entity);
+                cache.lookup.set(entity_index(entity), entity);
+            }
+        }
+    }
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Matched here so the tables of a new cache are not changed by
+    // threads that find it later
+    match_tables(&cache);
+#endif
+    return &cache;
+}
+
+inline const std::vector<Entity> &World::view_entities(const ViewMask &mask) {
+    auto *cache = find_or_make_cache(mask);
+    if (LIKELY(cache->diffs.empty())) {
+        return cache->entities;
+    }
+    apply_diffs_to_cache(cache);
+    return cache->entities;
+}
+
+#ifdef TWO_STORAGE_ARCHETYPE
+inline const std::vector<internal::Archetype *> &World::match_tables(
+        EntityCache *cache) {
+    const auto &tables = archetypes->tables();
+    for (; cache->tables_seen < tables.size(); ++cache->tables_seen) {
+        auto *table = tables[cache->tables_seen].get();
+        if (cache->mask.matches(table->mask)) {
+            cache->tables.push_back(table);
+        }
+    }
+    return cache->tables;
+}
+#endif
+
+inline void World::apply_diffs_to_cache(EntityCache *cache) {
+    ASSERT(cache != nullptr);
+    if (cache->diffs.empty()) {
+        return;
+    }
+    for (const auto &diff : cache->diffs) {
+        auto index = entity_index(diff.entity);
+        switch (diff.op) {
+        case EntityCache::Diff::Add:
+            cache->positions.set(index, cache->entities.size());
+            cache->entities.push_back(diff.entity);
+            break;
+        case EntityCache::Diff::Remove:
+            {
+                auto &vec = cache->entities;
+                auto pos = cache->positions.get(index);
+                ASSERT(pos != InvalidIndex && vec[pos] == diff.entity);
+
+                // Move the last entity into the empty slot
+                auto moved = vec.back();
+                vec[pos] = moved;
+                cache->positions.set(entity_index(moved), pos);
+                cache->positions.set(index, InvalidIndex);
+                vec.pop_back();
+                break;
+            }
+        default:
+            ASSERTS(false, "Invalid cache operation");
+            break;
+        }
+    }
+    cache->diffs.clear();
+}
+
+inline CommandBuffer &World::commands() {
+    auto *pool = get_thread_pool();
+    ASSERTS(!pool->other_pool_thread(),
+            "Commands recorded from a worker of another thread pool");
+    auto &buffer = *thread_commands[pool->thread_index()];
+    // The buffers keep pointing to the old world after it was moved.
+    buffer.world = this;
+    return buffer;
+}
+
+inline void World::playback_commands() {
+    begin_playback();
+    for (auto &buffer : thread_commands) {
+        buffer->playback(this);
+    }
+    end_playback();
+}
+
+inline void World::playback(CommandBuffer &buffer) {
+    ASSERTS(buffer.world == this, "Command buffer belongs to another world");
+    begin_playback();
+    buffer.playback(this);
+    end_playback();
+}
+
+inline void World::begin_playback() {
+    ASSERTS(parallel_sections == 0,
+            "Structural change while running in parallel");
+    ASSERT(!batching);
+    add_reserved_entities();
+    batching = true;
+}
+
+inline bool World::alive(Entity entity) const {
+    auto slot = entity_slots.get(entity_index(entity));
+    return slot != InvalidIndex && entities[slot] == entity;
+}
+
+inline void World::end_playback() {
+    batching = false;
+    for (const auto &changed : batched_changes) {
+        auto entity = changed.first;
+        batched_slots.set(entity_index(entity), InvalidIndex);
+
+        // Destroyed entities were already removed from the caches
+        if (alive(entity)) {
+            update_caches(entity, changed.second);
+        }
+    }
+    batched_changes.clear();
+}
+
+inline void World::flush_caches() {
+    for (auto &cached : view_cache) {
+        apply_diffs_to_cache(&cached.second);
+#ifdef TWO_STORAGE_ARCHETYPE
+        match_tables(&cached.second);
+#endif
+    }
+}
+
+inline void World::invalidate_cache(EntityCache *c, EntityCache::Diff &&diff) {
+    // Callers check `contains` before invalidating, since the lookup is
+    // updated here an entity can never be added or removed twice in a row.
+    auto index = entity_index(diff.entity);
+    if (diff.op == EntityCache::Diff::Add)
+        c->lookup.set(index, diff.entity);
+    else
+        c->lookup.set(index, NullEntity);
+    c->diffs.emplace_back(std::move(diff));
+}
+
+template <typename Event>
+EventChannel<Event> *World::find_or_make_channel() {
+    constexpr auto type = type_id<Event>();
+    auto &channel = channels[type];
+    if (channel == nullptr) {
+        size_t threads = thread_pool != nullptr ? thread_pool->size() : 1;
+        channel.reset(new EventChannel<Event>(threads));
+    }
+    return static_cast<EventChannel<Event> *>(channel.get());
+}
+
+template <typename Event>
+EventChannel<Event> *World::find_channel() const {
+    auto chan_it = channels.find(type_id<Event>());
+    if (chan_it == channels.end()) {
+        return nullptr;
+    }
+    return static_cast<EventChannel<Event> *>(chan_it->second.get());
+}
+
+template <typename Event>
+void World::bind(typename EventChannel<Event>::EventHandler &&fn) {
+    find_or_make_channel<Event>()->bind(std::move(fn));
+}
+
+template <typename Event>
+void World::bind_batch(typename EventChannel<Event>::BatchHandler &&fn) {
+    find_or_make_channel<Event>()->bind_batch(std::move(fn));
+}
+
+template <typename Event, typename Func, class T>
+void World::bind(Func &&fn, T this_ptr) {
+    bind<Event>(typename EventChannel<Event>::EventHandler(fn, this_ptr));
+}
+
+template <typename Event>
+void World::emit(const Event &event) const {
+    auto *channel = find_channel<Event>();
+    if (channel != nullptr) {
+        channel->emit(event);
+    }
+}
+
+template <typename Event>
+void World::enqueue(Event &&event) {
+    using T = typename std::decay<Event>::type;
+    // Channels are only read here so events can be queued in parallel
+    auto *channel = find_channel<T>();
+    if (channel == nullptr) {
+        return;
+    }
+    ASSERTS((thread_pool == nullptr || !thread_pool->other_pool_thread()),
+            "Event queued from a worker of another thread pool");
+    auto thread = thread_pool != nullptr ? thread_pool->thread_index() : 0;
+    channel->enqueue(thread, std::forward<Event>(event));
+}
+
+inline void World::dispatch_events() {
+    // Collect every channel first, so events queued by the handlers are
+    // left for the next call.
+    for (auto &channel : channels) {
+        channel.second->collect();
+    }
+    for (auto &channel : channels) {
+        channel.second->dispatch();
+    }
+}
+
+inline void World::load() {}
+inline void World::update(float) {}
+inline void World::unload() {}
+
+inline Job World::schedule_systems(float dt, const Job &parent) {
+    auto *pool = get_thread_pool();
+    flush_caches();
+
+    auto frame = pool->make_job([] {}, parent);
+    std::vector<SystemAccess> access;
+    std::vector<Job> jobs;
+    for (size_t i = 0; i < active_systems.size(); ++i) {
+        auto *system = active_systems[i];
+        access.push_back(system->access());
+        bool exclusive = access[i].exclusive;
+
+        auto job = pool->make_job([this, system, dt, exclusive] {
+            if (exclusive) {
+                system->update(this, dt);
+                // The next systems may run in parallel
+                flush_caches();
+                return;
+            }
+            ++parallel_sections;
+            system->update(this, dt);
+            --parallel_sections;
+        }, frame);
+
+        // Conflicting systems update in the order they were registered
+        for (size_t j = 0; j < i; ++j) {
+            if (access[i].conflicts(access[j])) {
+                pool->depends_on(job, jobs[j]);
+            }
+        }
+        jobs.push_back(job);
+    }
+    for (auto &job : jobs) {
+        pool->schedule(job);
+    }
+    pool->schedule(frame);
+    return frame;
+}
+
+template <typename... Components>
+inline const std::vector<Entity> &View<Components...>::entities() {
+    ASSERTS(cache != nullptr, "View was not created by a World");
+    if (UNLIKELY(!cache->diffs.empty())) {
+        world->apply_diffs_to_cache(cache);
+    }
+    return cache->entities;
+}
+
+template <typename... Components>
+template <typename Component>
+inline ComponentRef<Component> View<Components...>::unpack(Entity entity) {
+    ASSERT_ENTITY(entity);
+    constexpr auto i = internal::IndexOf<Component, Components...>::value;
+    return std::get<i>(arrays)->read(entity);
+}
+
+template <typename... Components>
+template <typename Func>
+inline void View<Components...>::each(Func &&fn) {
+#ifdef TWO_STORAGE_ARCHETYPE
+    ASSERTS(cache != nullptr, "View was not created by a World");
+    // Entities without components are not in any table, see `World::each`
+    if (LIKELY(cache->mask.include.any())) {
+        internal::each_in_tables<Components...>(
+            world->match_tables(cache), arrays, fn);
+        return;
+    }
+    const auto &view = entities();
+    internal::each_in_range<Components...>(view, 0, view.size(), arrays, fn);
+#else
+    internal::each_in_view<Components...>(entities(), arrays, fn);
+#endif
+}
+
+template <typename... Components>
+inline const Entity *Group<Components...>::entities() const {
+    return std::get<0>(arrays)->entities().data();
+}
+
+template <typename... Components>
+template <typename Component>
+inline Component *Group<Components...>::data() {
+    constexpr auto i = internal::IndexOf<Component, Components...>::value;
+    return std::get<i>(arrays)->data();
+}
+
+template <typename... Components>
+template <typename Func>
+inline void Group<Components...>::each(Func &&fn) {
+    using TakesEntity = internal::EachTakesEntity<Func, Components &...>;
+    static_assert(TakesEntity::value
+                  || internal::IsCallable<Func &, Components &...>::value,
+                  "Function must take (Components &...) or "
+                  "(Entity, Components &...)");
+
+    ASSERTS(group != nullptr, "Group was not created by a World");
+    // Walked backwards so the function may remove the current entity from
+    // the group, see `internal::each_packed`.
+    for (size_t i = size(); i-- > 0;) {
+        if (UNLIKELY(i >= group->size)) {
+            i = group->size;
+            continue;
+        }
+        internal::invoke_each(TakesEntity(), fn, entities()[i],
+            std::get<internal::IndexOf<Components, Components...>::value>(
+                arrays)->data()[i]...);
+    }
+}
+
+template <typename... Components>
+template <typename Func>
+inline void Group<Components...>::each_chunk(Func &&fn) {
+    ASSERTS(group != nullptr, "Group was not created by a World");
+    if (size() > 0) {
+        fn(size(), data<Components>()...);
+    }
+}
+
+template <typename T>
+inline ComponentArray<T>::ComponentArray() {
+    // Approximate amount of memory reserved when the array is initialized,
+    // used to reduce the amount of initial allocations.
+    constexpr size_t MinSize = 1024;
+    packed_array.reserve(MinSize / sizeof(T));
+    packed_entities.reserve(MinSize / sizeof(T));
+}
+
+template <typename T>
+inline T &ComponentArray<T>::read(Entity entity) {
+    ASSERTS(find_index(entity) != InvalidIndex,
+            "Missing component on Entity.");
+    return packed_array[find_index(entity)];
+}
+
+template <typename T>
+T &ComponentArray<T>::write(Entity entity, const T &component) {
+    auto pos = find_index(entity);
+    if (pos != InvalidIndex) {
+        // Replace component
+        packed_array[pos] = component;
+        return packed_array[pos];
+    }
+    push_entity(entity);
+    packed_array.push_back(component);
+    return packed_array.back();
+}
+
+template <typename T>
+T &ComponentArray<T>::write(Entity entity, T &&component) {
+    auto pos = find_index(entity);
+    if (pos != InvalidIndex) {
+        // Replace component
+        packed_array[pos] = std::move(component);
+        return packed_array[pos];
+    }
+    push_entity(entity);
+    packed_array.push_back(std::move(component));
+    return packed_array.back();
+}
+
+template <typename T>
+template <typename... Args>
+T &ComponentArray<T>::emplace(Entity entity, Args &&...args) {
+    using Constructible = std::is_constructible<T, Args &&...>;
+    auto pos = find_index(entity);
+    if (pos != InvalidIndex) {
+        // Replace component, args may refer to the old component so it
+        // can't be destroyed before the new one is constructed.
+        packed_array[pos] = internal::construct<T>(
+            Constructible(), std::forward<Args>(args)...);
+        return packed_array[pos];
+    }
+    push_entity(entity);
+    emplace_back(Constructible(), std::forward<Args>(args)...);
+    return packed_array.back();
+}
+
+template <typename T>
+template <typename... Args>
+void ComponentArray<T>::emplace_back(std::true_type, Args &&...args) {
+    packed_array.emplace_back(std::forward<Args>(args)...);
+}
+
+template <typename T>
+template <typename... Args>
+void ComponentArray<T>::emplace_back(std::false_type, Args &&...args) {
+    packed_array.push_back(internal::construct<T>(
+        std::false_type(), std::forward<Args>(args)...));
+}
+
+template <typename T>
+bool ComponentArray<T>::remove(Entity entity) {
+    auto removed = find_index(entity);
+    if (removed == InvalidIndex) {
+        // This is a no-op since calling this as a virtual member function
+        // means there is no way for the caller to check if the entity
+        // contains a component. `contains` is not virtual as it needs to
+        // be fast.
+        return false;
+    }
+    // Move the last component into the empty slot to keep the array packed
+    auto last = packed_array.size() - 1;
+    if (removed != last) {
+        packed_array[removed] = std::move(packed_array[last]);
+    }
+    packed_array.pop_back();
+
+    // Need to know which entity "owns" the component we just moved
+    auto moved_entity = packed_entities[last];
+    packed_entities[removed] = moved_entity;
+
+    // Update the entity that has its component moved to reference
+    // the new location in the packed array
+    insert_index(moved_entity, removed);
+    insert_index(entity, InvalidIndex);
+    packed_entities.pop_back();
+    return true;
+}
+
+template <typename T>
+bool ComponentArray<T>::copy(Entity dst, Entity src) {
+    return copy_component(std::integral_constant<bool,
+        std::is_copy_constructible<T>::value
+        && std::is_copy_assignable<T>::value>(), dst, src);
+}
+
+template <typename T>
+bool ComponentArray<T>::copy_component(std::true_type, Entity dst,
+                                       Entity src) {
+    write(dst, read(src));
+    return true;
+}
+
+template <typename T>
+bool ComponentArray<T>::copy_component(std::false_type, Entity, Entity) {
+    return false;
+}
+
+template <typename T>
+void ComponentArray<T>::push_entity(Entity entity) {
+    ASSERT(packed_array.size() < TWO_ENTITY_MAX);
+    insert_index(entity, packed_array.size());
+    packed_entities.push_back(entity);
+}
+
+template <typename T>
+void ComponentArray<T>::swap(Entity entity, size_t index) {
+    auto pos = find_index(entity);
+    ASSERT(pos != InvalidIndex && index < packed_array.size());
+    if (pos == index) {
+        return;
+    }
+    auto other = packed_entities[index];
+    std::swap(packed_array[pos], packed_array[index]);
+    packed_entities[pos] = other;
+    packed_entities[index] = entity;
+    insert_index(other, pos);
+    insert_index(entity, index);
+}
+
+template <typename T>
+inline bool ComponentArray<T>::contains(Entity entity) const {
+    return find_index(entity) != InvalidIndex;
+}
+
+template <typename T>
+inline T *ComponentArray<T>::find(Entity entity) {
+    auto pos = find_index(entity);
+    return pos != InvalidIndex ? &packed_array[pos] : nullptr;
+}
+
+template <typename T>
+size_t ComponentArray<T>::find_index(Entity entity) const {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto i = entity_index(entity);
+    auto page = i / PageSize;
+    auto index = i & (PageSize - 1);
+
+    if (page >= sparse_array.size() || sparse_array[page] == nullptr) {
+        return InvalidIndex;
+    }
+    return sparse_array[page][index];
+}
+
+template <typename T>
+void ComponentArray<T>::insert_index(Entity entity, PackedSizeType value) {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto i = entity_index(entity);
+    auto page = i / PageSize;
+    auto index = i & (PageSize - 1);
+
+    if (sparse_array.size() <= page) {
+        sparse_array.resize(page + 1);
+    }
+    if (sparse_array[page] == nullptr) {
+        auto p =
+            std::unique_ptr<PackedSizeType[]>(new PackedSizeType[PageSize]);
+        std::fill(p.get(), p.get() + PageSize, InvalidIndex);
+        sparse_array[page] = std::move(p);
+    }
+    sparse_array[page][index] = value;
+}
+
+namespace internal {
+
+template <typename T, T Empty>
+inline T SparseArray<T, Empty>::get(TWO_ENTITY_INT_TYPE i) const {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto page = i / PageSize;
+    if (page >= pages.size() || pages[page] == nullptr) {
+        return Empty;
+    }
+    return pages[page][i & (PageSize - 1)];
+}
+
+template <typename T, T Empty>
+void SparseArray<T, Empty>::set(TWO_ENTITY_INT_TYPE i, T value) {
+    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
+    auto page = i / PageSize;
+    if (pages.size() <= page) {
+        pages.resize(page + 1);
+    }
+    if (pages[page] == nullptr) {
+        auto p = std::unique_ptr<T[]>(new T[PageSize]);
+        std::fill(p.get(), p.get() + PageSize, Empty);
+        pages[page] = std::move(p);
+    }
+    pages[page][i & (PageSize - 1)] = value;
+}
+
+} // internal
+
+namespace internal {
+
+template <typename T>
+T *AlignedAllocator<T>::allocate(size_t n) {
+    // The offset to the start of the allocation is stored before the
+    // aligned pointer.
+    constexpr size_t Align = TWO_SOA_ALIGNMENT;
+    static_assert((Align & (Align - 1)) == 0 && Align >= sizeof(void *),
+                  "TWO_SOA_ALIGNMENT must be a power of two");
+
+    auto *raw = static_cast<char *>(std::malloc(n * sizeof(T) + Align));
+    ASSERTS(raw != nullptr, "Out of memory");
+    auto *aligned = reinterpret_cast<char *>(
+        (reinterpret_cast<uintptr_t>(raw) + Align) & ~(Align - 1));
+    reinterpret_cast<void **>(aligned)[-1] = raw;
+    return reinterpret_cast<T *>(aligned);
+}
+
+template <typename T>
+void AlignedAllocator<T>::deallocate(T *p, size_t) {
+    std::free(reinterpret_cast<void **>(p)[-1]);
+}
+
+// Moves the last element of a vector to `i` and removes the last element.
+template <typename Vector>
+inline void remove_at(Vector &v, size_t i) {
+    if (i != v.size() - 1) {
+        v[i] = std::move(v.back());
+    }
+    v.pop_back();
+}
+
+template <typename... Fields>
+template <typename T>
+void SoaColumns<std::tuple<Fields...>>::push(type &columns,
+                                             const T &component) {
+    TWO_TEMPLATE_FOLD(
+        column<Fields>(columns).push_back(Fields::get(component)));
+}
+
+template <typename... Fields>
+template <typename T>
+void SoaColumns<std::tuple<Fields...>>::set(type &columns, size_t i,
+                                            const T &component) {
+    TWO_TEMPLATE_FOLD(column<Fields>(columns)[i] = Fields::get(component));
+}
+
+template <typename... Fields>
+template <typename T>
+void SoaColumns<std::tuple<Fields...>>::get(type &columns, size_t i,
+                                            T &component) {
+    TWO_TEMPLATE_FOLD(Fields::get(component) = column<Fields>(columns)[i]);
+}
+
+template <typename... Fields>
+void SoaColumns<std::tuple<Fields...>>::remove(type &columns, size_t i) {
+    TWO_TEMPLATE_FOLD(remove_at(column<Fields>(columns), i));
+}
+
+template <typename... Fields>
+template <typename Func>
+void SoaColumns<std::tuple<Fields...>>::apply(type &columns, size_t count,
+                                              Func &fn) {
+    fn(count, column<Fields>(columns).data()...);
+}
+
+} // internal
+
+template <typename T>
+inline T SoaRef<T>::get() const {
+    return array->get(index);
+}
+
+template <typename T>
+inline const SoaRef<T> &SoaRef<T>::operator=(const T &component) const {
+    array->set(index, component);
+    return *this;
+}
+
+template <typename T>
+template <size_t I>
+inline typename SoaArray<T>::template FieldType<I> &
+SoaRef<T>::field() const {
+    return array->template field<I>()[index];
+}
+
+template <typename T>
+inline SoaRef<T> SoaArray<T>::read(Entity entity) {
+    auto i = indices.get(entity_index(entity));
+    ASSERTS(i != InvalidIndex, "Missing component on Entity.");
+    return SoaRef<T>(this, i);
+}
+
+template <typename T>
+SoaRef<T> SoaArray<T>::write(Entity entity, const T &component) {
+    auto i = indices.get(entity_index(entity));
+    if (i != InvalidIndex) {
+        // Replace component
+        set(i, component);
+        return SoaRef<T>(this, i);
+    }
+    ASSERT(packed_entities.size() < TWO_ENTITY_MAX);
+    i = TWO_ENTITY_INT_TYPE(packed_entities.size());
+    indices.set(entity_index(entity), i);
+    packed_entities.push_back(entity);
+    Columns::push(columns, component);
+    return SoaRef<T>(this, i);
+}
+
+template <typename T>
+template <typename... Args>
+SoaRef<T> SoaArray<T>::emplace(Entity entity, Args &&...args) {
+    return write(entity, internal::construct<T>(
+        std::is_constructible<T, Args &&...>(),
+        std::forward<Args>(args)...));
+}
+
+template <typename T>
+bool SoaArray<T>::remove(Entity entity) {
+    auto removed = indices.get(entity_index(entity));
+    if (removed == InvalidIndex) {
+        return false;
+    }
+    // Move the last fields into the empty slot to keep the arrays packed
+    Columns::remove(columns, removed);
+    auto moved = packed_entities.back();
+    packed_entities[removed] = moved;
+    packed_entities.pop_back();
+    indices.set(entity_index(moved), removed);
+    indices.set(entity_index(entity), InvalidIndex);
+    return true;
+}
 
-    // All alive (but not necessarily active) entities.
-    std::vector<Entity> entities;
+template <typename T>
+bool SoaArray<T>::copy(Entity dst, Entity src) {
+    write(dst, read(src).get());
+    return true;
+}
 
-    std::unordered_map<EntityMask, EntityCache> view_cache;
+template <typename T>
+inline bool SoaArray<T>::contains(Entity entity) const {
+    return indices.get(entity_index(entity)) != InvalidIndex;
+}
 
-    // Index with component index from component_types[type]
-    std::array<std::unique_ptr<IComponentArray>, TWO_COMPONENT_MAX> components;
+template <typename T>
+inline T SoaArray<T>::get(size_t i) {
+    // Fields that are not in the layout are value initialized
+    T component = T();
+    Columns::get(columns, i, component);
+    return component;
+}
 
-    // Masks for all entities.
-    std::array<EntityMask, TWO_ENTITY_MAX> entity_masks{};
+template <typename T>
+inline void SoaArray<T>::set(size_t i, const T &component) {
+    Columns::set(columns, i, component);
+}
 
-    std::unordered_map<type_id_t, ComponentType> component_types;
+#ifdef TWO_STORAGE_ARCHETYPE
 
-    // Event channels.
-    std::unordered_map<type_id_t, unique_void_ptr_t> channels;
+namespace internal {
 
-    void apply_diffs_to_cache(EntityCache *cache);
-    void invalidate_cache(EntityCache *cache, EntityCache::Diff &&diff);
-};
+template <typename T>
+void Column<T>::move_row(size_t row, IColumn *dst) {
+    if (dst != nullptr) {
+        static_cast<Column<T> *>(dst)->data.push_back(std::move(data[row]));
+    }
+    if (row != data.size() - 1) {
+        data[row] = std::move(data.back());
+    }
+    data.pop_back();
+}
 
-inline const EntityMask &World::get_mask(Entity entity) const {
-    return entity_masks[entity_index(entity)];
+template <typename T>
+inline ColumnVector<T> *Archetype::column(ComponentType type) {
+    if (type >= columns.size() || columns[type] == nullptr) {
+        return nullptr;
+    }
+    return &static_cast<Column<T> *>(columns[type].get())->data;
 }
 
-template <typename Component>
-Component &World::pack(Entity entity, const Component &component) {
-    ASSERT_ENTITY(entity);
-    auto index = entity_index(entity);
-    auto current_mask = entity_masks[index];
-    auto &mask = entity_masks[index];
+inline void ArchetypeStore::register_column(ComponentType type,
+                                            MakeColumn make) {
+    // Tables that already exist never contained this component type
+    factories[type] = make;
+}
 
-    // Component may not have been regisered yet
-    auto type = find_or_register_component<Component>();
-    mask.set(type);
+inline Archetype *ArchetypeStore::find(Entity entity, size_t *row) const {
+    auto i = entity_index(entity);
+    auto id = entity_tables.get(i);
+    if (id == InvalidIndex) {
+        return nullptr;
+    }
+    *row = entity_rows.get(i);
+    return archetypes[id].get();
+}
 
-    auto *a = static_cast<ComponentArray<Component> *>(components[type].get());
-    auto &new_component = a->write(entity, component);
+inline void ArchetypeStore::move(Entity entity, const EntityMask &mask) {
+    size_t row = 0;
+    auto *from = find(entity, &row);
+    if (from == nullptr ? mask.none() : from->mask == mask) {
+        return;
+    }
+    auto i = entity_index(entity);
+    Archetype *to = nullptr;
+    if (mask.none()) {
+        entity_tables.set(i, InvalidIndex);
+        entity_rows.set(i, InvalidIndex);
+    } else {
+        to = find_or_make(mask);
+        entity_tables.set(i, to->id);
+        entity_rows.set(i, to->entities.size());
+        to->entities.push_back(entity);
+    }
+    if (from == nullptr) {
+        return;
+    }
+    for (auto type : from->types) {
+        IColumn *dst = nullptr;
+        if (to != nullptr && type < to->columns.size()) {
+            dst = to->columns[type].get();
+        }
+        from->columns[type]->move_row(row, dst);
+    }
+    // Move the last entity into the empty row
+    auto moved = from->entities.back();
+    from->entities[row] = moved;
+    from->entities.pop_back();
+    if (moved != entity) {
+        entity_rows.set(entity_index(moved), row);
+    }
+}
 
-    if (current_mask[type] == mask[type]) {
-        // entity already has a component of this type, the component was
-        // replaced, but since the mask is unchanged there is no need to
-        // rebuild the cache.
-        TWO_MSG("%s is unchanged since entity #%x is unchanged\n",
-                mask.to_string().c_str(), entity);
-        return new_component;
+inline Archetype *ArchetypeStore::find_or_make(const EntityMask &mask) {
+    auto it = lookup.find(mask);
+    if (LIKELY(it != lookup.end())) {
+        return it->second;
     }
+    TWO_MSG("%s table created\n", mask.to_string().c_str());
 
-    // Invalidate caches
-    for (auto &cached : view_cache) {
-        if ((mask & cached.first) != cached.first) {
-            continue;
-        }
-        auto &lookup = cached.second.lookup;
-        if (lookup.find(entity) != lookup.end()) {
-            // Entity is already in the cache
+    auto *table = new Archetype;
+    table->mask = mask;
+    table->id = archetypes.size();
+    for (size_t type = 0; type < TWO_COMPONENT_MAX; ++type) {
+        if (!mask.test(type) || factories[type] == nullptr) {
             continue;
         }
-
-        invalidate_cache(&cached.second,
-            EntityCache::Diff{entity, EntityCache::Diff::Add});
-
-        TWO_MSG("%s now includes entity #%x\n",
-                mask.to_string().c_str(), entity);
+        table->columns.resize(type + 1);
+        table->columns[type].reset(factories[type]());
+        table->types.push_back(ComponentType(type));
     }
-    return new_component;
+    archetypes.emplace_back(table);
+    lookup[mask] = table;
+    return table;
 }
 
-template <typename C0, typename... Cn>
-void World::pack(Entity entity, const C0 &component, const Cn &...components) {
-    pack(entity, component);
-    pack(entity, components...);
-}
+} // internal
 
-template <typename Component>
-inline Component &World::unpack(Entity entity) {
-    ASSERT_ENTITY(entity);
-    // Assume component was registered when it was packed
-    ASSERT(component_types.find(type_id<Component>())
-           != component_types.end());
+template <typename T>
+ArchetypeArray<T>::ArchetypeArray(internal::ArchetypeStore *store)
+    : store{store}, type{component_index<T>()} {
+    store->register_column(type, &internal::Column<T>::make);
+}
 
-    auto type = component_types[type_id<Component>()];
-    auto *a = static_cast<ComponentArray<Component> *>(components[type].get());
-    return a->read(entity);
+template <typename T>
+inline T &ArchetypeArray<T>::read(Entity entity) {
+    auto *component = find(entity);
+    ASSERTS(component != nullptr, "Missing component on Entity.");
+    return *component;
 }
 
-template <typename Component>
-inline bool World::contains(Entity entity) const {
-    // This function must work if a component has never been registered,
-    // since it's reasonable to check if an entity has a component when
-    // a component type has never been added to any entity.
-    auto type_it = component_types.find(type_id<Component>());
-    if (type_it == component_types.end()) {
-        return false;
+template <typename T>
+T &ArchetypeArray<T>::write(Entity entity, const T &component) {
+    size_t row;
+    auto *column = prepare(entity, &row);
+    if (row < column->size()) {
+        // Replace component
+        (*column)[row] = component;
+        return (*column)[row];
     }
-    return entity_masks[entity].test(type_it->second);
+    column->push_back(component);
+    return column->back();
 }
 
-template <typename C0, typename... Cn, typename Enable>
-inline bool World::contains(Entity entity) const {
-    return contains<C0>(entity) && contains<Cn...>(entity);
+template <typename T>
+T &ArchetypeArray<T>::write(Entity entity, T &&component) {
+    size_t row;
+    auto *column = prepare(entity, &row);
+    if (row < column->size()) {
+        (*column)[row] = std::move(component);
+        return (*column)[row];
+    }
+    column->push_back(std::move(component));
+    return column->back();
 }
 
-template <typename Component>
-void World::remove(Entity entity) {
-    // Assume component was registered when it was packed
-    ASSERT(component_types.find(type_id<Component>())
-           != component_types.end());
-
-    auto type = component_types[type_id<Component>()];
-    auto *a = static_cast<ComponentArray<Component> *>(components[type].get());
+template <typename T>
+template <typename... Args>
+T &ArchetypeArray<T>::emplace(Entity entity, Args &&...args) {
+    return write(entity, internal::construct<T>(
+        std::is_constructible<T, Args &&...>(),
+        std::forward<Args>(args)...));
+}
 
-    if (!a->remove(entity)) {
-        // No need to invalidate caches since the entity didn't have
-        // a component of this type.
-        return;
+template <typename T>
+bool ArchetypeArray<T>::remove(Entity entity) {
+    size_t row;
+    auto *table = store->find(entity, &row);
+    if (table == nullptr || table->column<T>(type) == nullptr) {
+        return false;
     }
+    store->move(entity, EntityMask(table->mask).reset(type));
+    return true;
+}
 
-    // Invalidate caches
-    for (auto &cached : view_cache) {
-        if (!cached.first[type]) {
-            continue;
-        }
-        auto &lookup = cached.second.lookup;
-        if (lookup.find(entity) == lookup.end()) {
-            // Entity has already been removed from cache
-            continue;
-        }
-        invalidate_cache(&cached.second,
-            EntityCache::Diff{entity, EntityCache::Diff::Remove});
-
-        TWO_MSG("%s no longer includes entity #%x\n",
-                cached.first.to_string().c_str(), entity);
-    }
-    entity_masks[entity_index(entity)].reset(type);
+template <typename T>
+bool ArchetypeArray<T>::copy(Entity dst, Entity src) {
+    return copy_component(std::integral_constant<bool,
+        std::is_copy_constructible<T>::value
+        && std::is_copy_assignable<T>::value>(), dst, src);
 }
 
-inline void World::set_active(Entity entity, bool active) {
-    ASSERT_ENTITY(entity);
-    // If active is constant this conditional should be removed when
-    // the function is inlined
-    if (active)
-        pack(entity, Active{});
-    else
-        remove<Active>(entity);
+template <typename T>
+bool ArchetypeArray<T>::copy_component(std::true_type, Entity dst,
+                                       Entity src) {
+    // Writing may move the entity to the table of `src`, so the
+    // component is copied first.
+    T component(read(src));
+    write(dst, std::move(component));
+    return true;
 }
 
-template <typename... Components>
-const std::vector<Entity> &World::view(bool include_inactive) {
-    static const ComponentType active_component_t =
-        find_or_register_component<Active>();
+template <typename T>
+bool ArchetypeArray<T>::copy_component(std::false_type, Entity, Entity) {
+    return false;
+}
 
-    EntityMask mask;
-    // Component may not have been registered
-    TWO_TEMPLATE_FOLD(mask.set(find_or_register_component<Components>()));
+template <typename T>
+inline bool ArchetypeArray<T>::contains(Entity entity) const {
+    return find(entity) != nullptr;
+}
 
-    if (!include_inactive) {
-        mask.set(active_component_t);
+template <typename T>
+inline T *ArchetypeArray<T>::find(Entity entity) const {
+    size_t row;
+    auto *table = store->find(entity, &row);
+    if (table == nullptr) {
+        return nullptr;
     }
+    auto *column = table->column<T>(type);
+    if (column == nullptr || row >= column->size()) {
+        return nullptr;
+    }
+    return &(*column)[row];
+}
 
-    auto cache_it = view_cache.find(mask);
-    if (LIKELY(cache_it != view_cache.end())) {
-        auto &cache = cache_it->second;
-
-        TWO_MSG("%s view (%lu) [ops: %lu]\n",
-                mask.to_string().c_str(),
-                cache.entities.size(),
-                cache.diffs.size());
-
-        if (LIKELY(cache.diffs.empty())) {
-            return cache.entities;
-        }
-        apply_diffs_to_cache(&cache);
-        return cache.entities;
+template <typename T>
+internal::ColumnVector<T> *ArchetypeArray<T>::prepare(Entity entity,
+                                                      size_t *row) {
+    auto *table = store->find(entity, row);
+    auto *column = table != nullptr ? table->column<T>(type) : nullptr;
+    if (column != nullptr) {
+        return column;
     }
-    TWO_MSG("%s view (initial cache build)\n", mask.to_string().c_str());
+    auto mask = table != nullptr ? table->mask : EntityMask();
+    store->move(entity, mask.set(type));
+    table = store->find(entity, row);
+    return table->column<T>(type);
+}
 
-    std::vector<Entity> cache;
-    std::unordered_set<Entity> lookup;
+#endif
 
-    for (auto entity : entities) {
-        if ((mask & entity_masks[entity_index(entity)]) == mask) {
-            if (LIKELY(entity != NullEntity)) {
-                cache.push_back(entity);
-                lookup.insert(entity);
-            }
-        }
-    }
-    view_cache.emplace(std::make_pair(mask,
-        EntityCache{std::move(cache), {}, std::move(lookup)}));
+inline void System::load(World *) {}
+inline void System::update(World *, float) {}
+inline void System::draw(World *) {}
+inline void System::unload(World *) {}
+inline SystemAccess System::access() const { return SystemAccess(true); }
 
-    return view_cache[mask].entities;
+template <typename R, typename... Args>
+template <typename Func, typename>
+Delegate<R (Args...)>::Delegate(Func &&fn) {
+    using F = typename std::decay<Func>::type;
+    init(std::forward<Func>(fn), IsInline<F>());
 }
 
-template <typename... Components>
-inline void World::each(ViewFunc<void (Components &...)> &&fn,
-                        bool include_inactive) {
-    for (const auto entity : view<Components...>(include_inactive)) {
-        fn(unpack<Components>(entity)...);
-    }
+template <typename R, typename... Args>
+template <typename Method, class T>
+Delegate<R (Args...)>::Delegate(Method method, T object) {
+    init(MemberCall<Method, T>{method, object},
+         IsInline<MemberCall<Method, T>>());
 }
 
-template <typename... Components>
-inline void World::each(ViewFunc<void (Entity, Components &...)> &&fn,
-                        bool include_inactive) {
-    for (const auto entity : view<Components...>(include_inactive)) {
-        fn(entity, unpack<Components>(entity)...);
-    }
+template <typename R, typename... Args>
+Delegate<R (Args...)>::Delegate(Delegate &&other) noexcept {
+    *this = std::move(other);
 }
 
-template <typename... Components>
-Optional<Entity> World::view_one(bool include_inactive) {
-    auto &v = view<Components...>(include_inactive);
-    if (v.size() > 0) {
-        return v[0];
+template <typename R, typename... Args>
+Delegate<R (Args...)> &Delegate<R (Args...)>::operator=(
+        Delegate &&other) noexcept {
+    if (this == &other) {
+        return *this;
     }
-    return {};
+    reset();
+    call = other.call;
+    manage = other.manage;
+    if (manage != nullptr)
+        manage(&storage, &other.storage);
+    else
+        storage = other.storage;
+    other.call = nullptr;
+    other.manage = nullptr;
+    return *this;
 }
 
-template <typename Component>
-Component &World::unpack_one(bool include_inactive) {
-    auto &v = view<Component>(include_inactive);
-    ASSERTS(v.size() > 0, "No entities were matched");
-    return unpack<Component>(v[0]);
+template <typename R, typename... Args>
+template <typename F>
+void Delegate<R (Args...)>::init(F &&fn, std::true_type) {
+    using T = typename std::decay<F>::type;
+    new (&storage) T(std::forward<F>(fn));
+    call = call_inline<T>;
+    manage = IsTrivial<T>() ? nullptr : manage_inline<T>;
 }
 
-template <class T, typename... Args>
-T *World::make_system(Args &&...args) {
-    return make_system(new T(std::forward<Args>(args)...));
+template <typename R, typename... Args>
+template <typename F>
+void Delegate<R (Args...)>::init(F &&fn, std::false_type) {
+    using T = typename std::decay<F>::type;
+    *reinterpret_cast<T **>(&storage) = new T(std::forward<F>(fn));
+    call = call_allocated<T>;
+    manage = manage_allocated<T>;
 }
 
-template <class T>
-T *World::make_system(T *system) {
-    static_assert(std::is_convertible<T *, System *>(),
-                  "Type cannot be converted to a System");
-    ASSERTS_PARANOIA(
-        std::find(active_systems.begin(),
-                  active_systems.end(), system) == active_systems.end(),
-        "Duplicate systems in the world");
-
-    active_systems.push_back(system);
-    active_system_types.push_back(type_id<T>());
-    system->load(this);
-    return system;
+template <typename R, typename... Args>
+inline void Delegate<R (Args...)>::reset() {
+    if (manage != nullptr) {
+        manage(nullptr, &storage);
+    }
+    call = nullptr;
+    manage = nullptr;
 }
 
-template <class Before, class T, typename... Args>
-T *World::make_system_before(Args &&...args) {
-    static_assert(std::is_convertible<T *, System *>(),
-                  "Type cannot be converted to a System");
-    ASSERT(active_systems.size() == active_system_types.size());
+template <typename R, typename... Args>
+template <typename F>
+R Delegate<R (Args...)>::call_inline(Storage &storage, Args... args) {
+    return (*reinterpret_cast<F *>(&storage))(std::forward<Args>(args)...);
+}
 
-    auto pos = std::find(active_system_types.begin(),
-                         active_system_types.end(),
-                         type_id<Before>());
+template <typename R, typename... Args>
+template <typename F>
+R Delegate<R (Args...)>::call_allocated(Storage &storage, Args... args) {
+    return (**reinterpret_cast<F **>(&storage))(std::forward<Args>(args)...);
+}
 
-    auto *system = new T(std::forward<Args>(args)...);
-    if (pos == active_system_types.end()) {
-        return system;
+template <typename R, typename... Args>
+template <typename F>
+void Delegate<R (Args...)>::manage_inline(Storage *dst, Storage *src) {
+    auto *fn = reinterpret_cast<F *>(src);
+    if (dst != nullptr) {
+        new (dst) F(std::move(*fn));
     }
-    size_t index = std::distance(pos, active_system_types.end()) - 1;
-    active_systems.insert(active_systems.begin() + index, system);
-    active_system_types.insert(pos, type_id<T>());
-    return system;
+    fn->~F();
 }
 
-template <class T>
-T *World::get_system() {
-    static_assert(std::is_convertible<T *, System *>(),
-                  "Type cannot be converted to a System");
-    ASSERT(active_systems.size() == active_system_types.size());
+template <typename R, typename... Args>
+template <typename F>
+void Delegate<R (Args...)>::manage_allocated(Storage *dst, Storage *src) {
+    auto *fn = *reinterpret_cast<F **>(src);
+    if (dst != nullptr)
+        *reinterpret_cast<F **>(dst) = fn;
+    else
+        delete fn;
+}
 
-    auto pos = std::find(active_system_types.begin(),
-                         active_system_types.end(),
-                         type_id<T>());
+template <typename Event>
+void EventChannel<Event>::bind(EventHandler &&fn) {
+    handlers.push_back(std::move(fn));
+}
 
-    if (pos == active_system_types.end()) {
-        return nullptr;
+template <typename Event>
+void EventChannel<Event>::bind_batch(BatchHandler &&fn) {
+    batch_handlers.push_back(std::move(fn));
+}
+
+template <typename Event>
+void EventChannel<Event>::emit(const Event &event) const {
+    for (const auto &fn : handlers) {
+        if (fn(event)) break;
     }
-    auto index = std::distance(active_system_types.begin(), pos);
-    return static_cast<T *>(active_systems[index]);
 }
 
-template <class T>
-void World::get_all_systems(std::vector<T *> *systems) {
-    static_assert(std::is_convertible<T *, System *>(),
-                  "Type cannot be converted to a System");
-    ASSERT(active_systems.size() == active_system_types.size());
-    ASSERT(systems != nullptr);
+template <typename Event>
+template <typename T>
+void EventChannel<Event>::enqueue(size_t thread, T &&event) {
+    ASSERT(thread < queues.size());
+    queues[thread]->emplace_back(std::forward<T>(event));
+}
 
-    for (size_t i = 0; i < active_systems.size(); ++i) {
-        if (active_system_types[i] != type_id<T>()) {
+template <typename Event>
+void EventChannel<Event>::collect() {
+    for (auto &queue : queues) {
+        if (events.empty()) {
+            events.swap(*queue);
             continue;
         }
-        systems->push_back(static_cast<T *>(active_systems[i]));
+        std::move(queue->begin(), queue->end(), std::back_inserter(events));
+        queue->clear();
     }
 }
 
-template <typename Component>
-void World::register_component() {
-    // Component must not already exist
-    ASSERT(component_types.find(
-        type_id<Component>()) == component_types.end());
-
-    int i = component_type_index++;
-    component_types.emplace(std::make_pair(type_id<Component>(), i));
-    components[i] = std::unique_ptr<ComponentArray<Component>>(
-        new ComponentArray<Component>);
+template <typename Event>
+void EventChannel<Event>::dispatch() {
+    if (events.empty()) {
+        return;
+    }
+    // Handled events only need to be tracked if another handler follows
+    if (handlers.size() == 1 && batch_handlers.empty()) {
+        const auto &fn = handlers[0];
+        for (const auto &event : events) {
+            fn(event);
+        }
+        events.clear();
+        return;
+    }
+    handled.assign(events.size(), false);
+    for (const auto &fn : handlers) {
+        for (size_t i = 0; i < events.size(); ++i) {
+            if (!handled[i] && fn(events[i])) handled[i] = true;
+        }
+    }
+    if (!batch_handlers.empty()) {
+        // Only pass on events that were not handled
+        size_t count = 0;
+        for (size_t i = 0; i < events.size(); ++i) {
+            if (handled[i]) continue;
+            if (count != i) events[count] = std::move(events[i]);
+            ++count;
+        }
+        for (const auto &fn : batch_handlers) {
+            fn(count, events.data());
+        }
+    }
+    events.clear();
 }
 
-template <typename Component>
-inline ComponentType World::find_or_register_component() {
-    auto match = component_types.find(type_id<Component>());
-    if (LIKELY(match != component_types.end())) {
-        return match->second;
+template <typename Event>
+void EventChannel<Event>::resize(size_t threads) {
+    while (queues.size() < threads) {
+        queues.emplace_back(new std::vector<Event>);
     }
-    register_component<Component>();
-    return component_types[type_id<Component>()];
 }
 
-inline Entity World::make_entity() {
+inline Entity CommandBuffer::make_entity() {
     auto entity = make_inactive_entity();
     pack(entity, Active{});
     return entity;
 }
 
-inline Entity World::make_entity(Entity archetype) {
-    ASSERT_ENTITY(archetype);
-    auto entity = make_entity();
-    copy_entity(entity, archetype);
-    return entity;
+inline Entity CommandBuffer::make_inactive_entity() {
+    return world->reserve_entity();
 }
 
-inline Entity World::make_inactive_entity() {
-    Entity entity;
-    if (unused_entities.empty()) {
-        ASSERTS(alive_count < TWO_ENTITY_MAX, "Too many entities");
-        entity = alive_count++;
+template <typename Component>
+void CommandBuffer::pack(Entity entity, Component &&component) {
+    ASSERT_ENTITY(entity);
+    using T = PackCommand<typename std::decay<Component>::type>;
+    auto *command = new (allocate(sizeof(T), alignof(T)))
+        T(std::forward<Component>(component));
+    append(command, entity, apply_pack<typename std::decay<Component>::type>,
+           discard_pack<typename std::decay<Component>::type>);
+}
 
-        // Create a nullentity that will never have any components
-        // This is useful when we need to store entities in an array and
-        // need a way to define entities that are not valid.
-        if (entity == NullEntity) {
-            entities.push_back(NullEntity);
-            ++entity;
-            ++alive_count;
-        }
-    } else {
-        entity = unused_entities.back();
-        unused_entities.pop_back();
-        auto version = entity_version(entity);
-        auto index = entity_index(entity);
-        entity = entity_id(index, version + 1);
-    }
-    entities.push_back(entity);
-    return entity;
+template <typename C0, typename C1, typename... Cn>
+void CommandBuffer::pack(Entity entity, C0 &&c0, C1 &&c1, Cn &&...components) {
+    pack(entity, std::forward<C0>(c0));
+    pack(entity, std::forward<C1>(c1), std::forward<Cn>(components)...);
 }
 
-inline void World::copy_entity(Entity dst, Entity src) {
-    ASSERT_ENTITY(dst);
-    auto &dst_mask = entity_masks[entity_index(dst)];
-    auto &src_mask = entity_masks[entity_index(src)];
-    for (const auto &type_it : component_types) {
-        if (!src_mask.test(type_it.second)) {
-            continue;
+template <typename Component>
+void CommandBuffer::remove(Entity entity) {
+    ASSERT_ENTITY(entity);
+    auto *command = new (allocate(sizeof(Command), alignof(Command))) Command;
+    append(command, entity, apply_remove<Component>, nullptr);
+}
+
+inline void CommandBuffer::destroy_entity(Entity entity) {
+    ASSERT_ENTITY(entity);
+    auto *command = new (allocate(sizeof(Command), alignof(Command))) Command;
+    append(command, entity, apply_destroy, nullptr);
+}
+
+inline void CommandBuffer::clear() {
+    for (auto *command = head; command != nullptr; command = command->next) {
+        if (command->discard != nullptr) {
+            command->discard(command);
         }
-        auto &a = components[type_it.second];
-        a->copy(dst, src);
-        dst_mask.set(type_it.second);
     }
+    reset();
+}
 
-    for (auto &cached : view_cache) {
-        if ((dst_mask & cached.first) != cached.first) {
-            continue;
+inline void *CommandBuffer::allocate(size_t size, size_t align) {
+    for (;;) {
+        if (block == blocks.size()) {
+            // Commands larger than a block get a block of their own
+            Block b;
+            b.size = std::max(size + align, size_t(16 << 10));
+            b.data.reset(new unsigned char[b.size]);
+            blocks.emplace_back(std::move(b));
         }
-        auto &lookup = cached.second.lookup;
-        if (lookup.find(dst) != lookup.end()) {
-            continue;
+        auto *data = blocks[block].data.get();
+        auto address = reinterpret_cast<uintptr_t>(data) + used;
+        auto offset = used + (align - address % align) % align;
+        if (offset + size <= blocks[block].size) {
+            used = offset + size;
+            return data + offset;
         }
-
-        invalidate_cache(&cached.second,
-            EntityCache::Diff{dst, EntityCache::Diff::Add});
-
-        TWO_MSG("%s now includes entity #%x (copied from #%x)\n",
-                dst_mask.to_string().c_str(), dst, src);
+        ++block;
+        used = 0;
     }
 }
 
-inline void World::destroy_entity(Entity entity) {
-    ASSERT_ENTITY(entity);
-    for (auto &a : components) {
-        if (a != nullptr) {
-            a->remove(entity);
+inline void CommandBuffer::append(Command *command, Entity entity,
+                                  void (*apply)(World *, Command *),
+                                  void (*discard)(Command *)) {
+    command->apply = apply;
+    command->discard = discard;
+    command->next = nullptr;
+    command->entity = entity;
+    if (tail != nullptr)
+        tail->next = command;
+    else
+        head = command;
+    tail = command;
+}
+
+inline void CommandBuffer::playback(World *world) {
+    for (auto *command = head; command != nullptr;) {
+        // The command is destroyed once it is applied
+        auto *next = command->next;
+        if (world->alive(command->entity)) {
+            command->apply(world, command);
+        } else if (command->discard != nullptr) {
+            // Destroyed by an earlier command, possibly in another buffer
+            command->discard(command);
         }
+        command = next;
     }
-    entity_masks[entity_index(entity)] = 0;
+    reset();
+}
 
-    DestroyedEntity destroyed;
-    destroyed.entity = entity;
+inline void CommandBuffer::reset() {
+    head = nullptr;
+    tail = nullptr;
+    block = 0;
+    used = 0;
+}
 
-    for (auto &cached : view_cache) {
-        auto &lookup = cached.second.lookup;
-        if (lookup.find(entity) == lookup.end()) {
-            continue;
-        }
-        cached.second.diffs.emplace_back(
-            EntityCache::Diff{entity, EntityCache::Diff::Remove});
+template <typename Component>
+void CommandBuffer::apply_pack(World *world, Command *command) {
+    auto *pack = static_cast<PackCommand<Component> *>(command);
+    world->pack(pack->entity, std::move(pack->component));
+    pack->~PackCommand<Component>();
+}
 
-        // This cache must be rebuilt before the entity can be reused.
-        destroyed.caches.push_back(&cached.second);
+template <typename Component>
+void CommandBuffer::discard_pack(Command *command) {
+    static_cast<PackCommand<Component> *>(command)->~PackCommand<Component>();
+}
 
-        TWO_MSG("%s no longer includes entity #%x (destroyed)\n",
-                cached.first.to_string().c_str(), entity);
+template <typename Component>
+void CommandBuffer::apply_remove(World *world, Command *command) {
+    world->remove<Component>(command->entity);
+}
+
+inline void CommandBuffer::apply_destroy(World *world, Command *command) {
+    world->destroy_entity(command->entity);
+}
+
+inline ThreadPool::ThreadPool(size_t threads) {
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        queues.emplace_back(new Queue);
+    }
+    for (size_t i = 1; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::work, this, i);
     }
-    auto rem = std::find(entities.begin(), entities.end(), entity);
-    ASSERT(rem != entities.end());
-    std::swap(*rem, entities.back());
-    entities.pop_back();
-    destroyed_entities.emplace_back(std::move(destroyed));
 }
 
-inline void World::collect_unused_entities() {
-    if (destroyed_entities.size() == 0) {
-        return;
+inline ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
     }
-    for (const auto &destroyed : destroyed_entities) {
-        for (auto *cache : destroyed.caches) {
-            // In most cases the cache will have no diffs since if this cache
-            // is viewed every frame by some system it would have been rebuilt
-            // by this point anyway.
-            apply_diffs_to_cache(cache);
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    // Releasing the queued jobs also releases the jobs waiting on them
+    for (auto &queue : queues) {
+        queue->jobs.clear();
+    }
+    size_t outstanding = 0;
+    for (auto &queue : queues) {
+        outstanding += queue->records - queue->free_jobs.size();
+        for (auto *job : queue->free_jobs) {
+            delete job;
         }
-        // Make entity id available again
-        unused_entities.push_back(destroyed.entity);
     }
-    destroyed_entities.clear();
+    ASSERTS(outstanding == 0, "Job handles outlived their ThreadPool");
 }
 
-inline void World::destroy_system(System *system) {
-    ASSERT(active_systems.size() == active_system_types.size());
-    ASSERT(system != nullptr);
-
-    auto pos = std::find(active_systems.begin(), active_systems.end(), system);
-    if (pos == active_systems.end()) {
-        TWO_MSG("warn: Trying to destroy a system that does not exist\n");
-        return;
+template <typename Func>
+Job ThreadPool::make_job(Func &&fn, const Job &parent) {
+    JobPtr job(acquire());
+    job->fn = std::forward<Func>(fn);
+    if (parent) {
+        ASSERTS(!parent.done(), "Parent job has already finished");
+        parent.data->unfinished.fetch_add(1, std::memory_order_relaxed);
+        job->parent = parent.data;
     }
-    system->unload(this);
-    delete system;
-
-    auto index = std::distance(active_systems.begin(), pos);
-    active_systems.erase(pos);
-    active_system_types.erase(active_system_types.begin() + index);
+    return Job(std::move(job));
 }
 
-inline void World::destroy_systems() {
-    for (auto *system : active_systems) {
-        system->unload(this);
-        delete system;
+inline void ThreadPool::depends_on(const Job &job, const Job &dependency) {
+    ASSERT(job && dependency);
+    std::lock_guard<std::mutex> lock(dependency.data->mutex);
+    if (dependency.done()) {
+        return;
     }
-    active_systems.clear();
-    active_system_types.clear();
+    job.data->waiting.fetch_add(1, std::memory_order_relaxed);
+    dependency.data->continuations.push_back(job.data);
 }
 
-inline void World::apply_diffs_to_cache(EntityCache *cache) {
-    ASSERT(cache != nullptr);
-    for (const auto &diff : cache->diffs) {
-        switch (diff.op) {
-        case EntityCache::Diff::Add:
-            cache->entities.push_back(diff.entity);
-            cache->lookup.insert(diff.entity);
-            break;
-        case EntityCache::Diff::Remove:
-            {
-                auto &vec = cache->entities;
-                auto rem = std::find(vec.begin(), vec.end(), diff.entity);
-                ASSERT(rem != vec.end());
-
-                std::swap(*rem, vec.back());
-                vec.pop_back();
-                cache->lookup.erase(diff.entity);
-                break;
-            }
-        default:
-            ASSERTS(false, "Invalid cache operation");
-            break;
-        }
+inline void ThreadPool::schedule(const Job &job) {
+    ASSERT(job);
+    if (job.data->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        push(JobPtr(job.data));
     }
-    cache->diffs.clear();
 }
 
-inline void World::invalidate_cache(EntityCache *c, EntityCache::Diff &&diff) {
-    for (const auto &d : c->diffs) {
-        if (d.entity == diff.entity && d.op == diff.op) {
-            return;
+inline void ThreadPool::wait(const Job &job) {
+    ASSERT(job);
+    // Attempts to find a job before blocking
+    constexpr int MaxSpins = 64;
+    auto index = thread_index();
+    int spins = 0;
+    while (!job.done()) {
+        auto next = pop(index);
+        if (next) {
+            execute(std::move(next));
+            spins = 0;
+        } else if (++spins < MaxSpins) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(mutex);
+            // Woken by `push` for new jobs and by `finish` for finished
+            // jobs, see `finish`.
+            ++sleeping;
+            ++waiters;
+            wake.wait(lock, [this, &job] {
+                return queued > 0 || job.data->finished.load();
+            });
+            --waiters;
+            --sleeping;
+            spins = 0;
         }
     }
-    c->diffs.emplace_back(std::move(diff));
 }
 
-template <typename Event>
-void World::bind(typename EventChannel<Event>::EventHandler &&fn) {
-    constexpr auto type = type_id<Event>();
-    if (channels.find(type) == channels.end()) {
-        auto c = unique_void_ptr<EventChannel<Event>>(new EventChannel<Event>);
-        channels.emplace(std::make_pair(type, std::move(c)));
+template <typename Func>
+void ThreadPool::run(size_t count, Func &&fn) {
+    using F = typename std::remove_reference<Func>::type;
+    if (workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; ++i) fn(i);
+        return;
     }
-    static_cast<EventChannel<Event> *>(channels.at(type).get())
-        ->bind(std::move(fn));
-}
-
-template <typename Event, typename Func, class T>
-void World::bind(Func &&fn, T this_ptr) {
-    bind<Event>(std::bind(fn, this_ptr, std::placeholders::_1));
+    F *f = &fn;
+    auto root = make_job([] {});
+    for (size_t i = 0; i < count; ++i) {
+        schedule(make_job([f, i] { (*f)(i); }, root));
+    }
+    schedule(root);
+    wait(root);
 }
 
-template <typename Event>
-void World::emit(const Event &event) const {
-    auto chan_it = channels.find(type_id<Event>());
-    if (chan_it == channels.end()) {
-        return;
+inline void ThreadPool::work(size_t index) {
+    thread_queue() = ThreadQueue{this, index};
+    for (;;) {
+        auto job = pop(index);
+        if (job) {
+            execute(std::move(job));
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        // Either this sees the new job or `push` sees this worker sleeping
+        ++sleeping;
+        wake.wait(lock, [this] { return stopping || queued > 0; });
+        --sleeping;
+        if (stopping) return;
     }
-    static_cast<EventChannel<Event> *>(chan_it->second.get())->emit(event);
 }
 
-inline void World::load() {}
-inline void World::update(float) {}
-inline void World::unload() {}
-
-template <typename T>
-inline ComponentArray<T>::ComponentArray() {
-    // Approximate amount of memory reserved when the array is initialized,
-    // used to reduce the amount of initial allocations.
-    constexpr size_t MinSize = 1024;
-    packed_array.reserve(MinSize / sizeof(T));
+inline size_t ThreadPool::thread_index() const {
+    const auto &current = thread_queue();
+    return current.pool == this ? current.index : 0;
 }
 
-template <typename T>
-inline T &ComponentArray<T>::read(Entity entity) {
-    ASSERTS(find_index(entity) != InvalidIndex,
-            "Missing component on Entity.");
-    return packed_array[find_index(entity)];
+inline bool ThreadPool::other_pool_thread() const {
+    const auto *pool = thread_queue().pool;
+    return pool != nullptr && pool != this;
 }
 
-template <typename T>
-T &ComponentArray<T>::write(Entity entity, const T &component) {
-    auto pos = find_index(entity);
-    if (pos != InvalidIndex) {
-        // Replace component
-        packed_array[pos] = component;
-        return packed_array[pos];
-    }
-    ASSERT(packed_count < TWO_ENTITY_MAX);
-
-    pos = packed_count++;
-    insert_index(entity, pos);
-    packed_to_entity[pos] = entity;
-
-    if (pos < packed_array.size())
-        packed_array[pos] = component;
-    else
-        packed_array.push_back(component);
-
-    return packed_array[pos];
+inline ThreadPool::ThreadQueue &ThreadPool::thread_queue() {
+    static thread_local ThreadQueue current{nullptr, 0};
+    return current;
 }
 
-template <typename T>
-bool ComponentArray<T>::remove(Entity entity) {
-    auto removed = find_index(entity);
-    if (removed == InvalidIndex) {
-        // This is a no-op since calling this as a virtual member function
-        // means there is no way for the caller to check if the entity
-        // contains a component. `contains` is not virtual as it needs to
-        // be fast.
-        return false;
+inline void ThreadPool::push(JobPtr &&job) {
+    auto &queue = *queues[thread_index()];
+    // Counted before it can be popped, so `queued` never goes below zero
+    ++queued;
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    if (sleeping > 0) {
+        // Locking ensures the worker is waiting and will be woken up
+        { std::lock_guard<std::mutex> lock(mutex); }
+        wake.notify_one();
     }
-    // Move the last component into the empty slot to keep the array packed
-    auto last = packed_count - 1;
-    packed_array[removed] = packed_array[last];
-
-    // Need to know which entity "owns" the component we just moved
-    auto moved_entity = packed_to_entity[last];
-    packed_to_entity[removed] = moved_entity;
-
-    // Update the entity that has its component moved to reference
-    // the new location in the packed array
-    insert_index(moved_entity, removed);
-    insert_index(entity, InvalidIndex);
-    packed_to_entity.erase(last);
-    --packed_count;
-    return true;
 }
 
-template <typename T>
-void ComponentArray<T>::copy(Entity dst, Entity src) {
-    write(dst, read(src));
+inline internal::JobData *ThreadPool::acquire() {
+    auto index = thread_index();
+    auto &queue = *queues[index];
+    {
+        std::lock_guard<std::mutex> lock(queue.free_mutex);
+        if (!queue.free_jobs.empty()) {
+            auto *job = queue.free_jobs.back();
+            queue.free_jobs.pop_back();
+            return job;
+        }
+        ++queue.records;
+    }
+    auto *job = new internal::JobData;
+    job->pool = this;
+    job->queue = index;
+    return job;
 }
 
-template <typename T>
-inline bool ComponentArray<T>::contains(Entity entity) const {
-    return find_index(entity) != InvalidIndex;
+inline void ThreadPool::release(internal::JobData *job) {
+    job->fn = nullptr;
+    job->parent.reset();
+    job->continuations.clear();
+    job->unfinished.store(1, std::memory_order_relaxed);
+    job->waiting.store(1, std::memory_order_relaxed);
+    job->finished.store(false, std::memory_order_relaxed);
+    job->references.store(0, std::memory_order_relaxed);
+    // Returned to the thread that made it, since jobs are often made by
+    // one thread and finished by others
+    auto &queue = *queues[job->queue];
+    std::lock_guard<std::mutex> lock(queue.free_mutex);
+    queue.free_jobs.push_back(job);
 }
 
-template <typename T>
-size_t ComponentArray<T>::find_index(Entity entity) const {
-    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
-    auto i = entity_index(entity);
-    auto page = i / PageSize;
-    auto index = i & (PageSize - 1);
-
-    if (page >= sparse_array.size() || sparse_array[page] == nullptr) {
-        return InvalidIndex;
+inline ThreadPool::JobPtr ThreadPool::pop(size_t index) {
+    if (queued.load(std::memory_order_relaxed) == 0) {
+        return nullptr;
     }
-    return sparse_array[page][index];
+    for (size_t i = 0; i < queues.size(); ++i) {
+        auto &queue = *queues[(index + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.empty()) {
+            continue;
+        }
+        JobPtr job;
+        if (i == 0) {
+            // Newest job in our own queue, its data is likely still cached
+            job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+        } else {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+        }
+        --queued;
+        return job;
+    }
+    return nullptr;
 }
 
-template <typename T>
-void ComponentArray<T>::insert_index(Entity entity, PackedSizeType value) {
-    constexpr auto PageSize = TWO_COMPONENT_ARRAY_PAGE_SIZE;
-    auto i = entity_index(entity);
-    auto page = i / PageSize;
-    auto index = i & (PageSize - 1);
+inline void ThreadPool::execute(JobPtr &&job) {
+    job->fn();
+    // Release anything captured by the function
+    job->fn = nullptr;
+    finish(std::move(job));
+}
 
-    if (sparse_array.size() <= page) {
-        sparse_array.resize(page + 1);
-    }
-    if (sparse_array[page] == nullptr) {
-        auto p =
-            std::unique_ptr<PackedSizeType[]>(new PackedSizeType[PageSize]);
-        std::fill(p.get(), p.get() + PageSize, InvalidIndex);
-        sparse_array[page] = std::move(p);
+inline void ThreadPool::finish(JobPtr job) {
+    while (job) {
+        if (job->unfinished.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+            return;
+        }
+        std::vector<JobPtr> continuations;
+        {
+            std::lock_guard<std::mutex> lock(job->mutex);
+            // Sequentially consistent with the load of `waiters` below, so
+            // either a waiting thread sees the job finished or this sees
+            // the waiting thread.
+            job->finished.store(true);
+            continuations.swap(job->continuations);
+        }
+        if (waiters > 0) {
+            { std::lock_guard<std::mutex> lock(mutex); }
+            wake.notify_all();
+        }
+        for (auto &next : continuations) {
+            if (next->waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                push(std::move(next));
+            }
+        }
+        // The parent may have been waiting on this job
+        auto parent = std::move(job->parent);
+        job = std::move(parent);
     }
-    sparse_array[page][index] = value;
 }
 
-inline void System::load(World *) {}
-inline void System::update(World *, float) {}
-inline void System::draw(World *) {}
-inline void System::unload(World *) {}
-
-template <typename Event>
-void EventChannel<Event>::bind(EventHandler &&fn) {
-    handlers.push_back(std::move(fn));
+inline internal::JobPtr::JobPtr(JobData *data) : data{data} {
+    if (data) {
+        data->references.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
-template <typename Event>
-void EventChannel<Event>::emit(const Event &event) const {
-    for (const auto &fn : handlers) {
-        if (fn(event)) break;
+inline void internal::JobPtr::reset() {
+    if (!data) {
+        return;
+    }
+    // Nothing else can add a reference while this is the only one
+    auto &references = data->references;
+    if (references.load(std::memory_order_acquire) == 1
+        || references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        data->pool->release(data);
     }
+    data = nullptr;
 }
 
 template <typename T>
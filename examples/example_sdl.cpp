@@ -119,9 +119,19 @@ static void spawn_particle(two::World *world, two::Entity entity,
 
 class ParticleSystem : public two::System {
 public:
+    void load(two::World *world) override {
+        particles = world->group<Transform, Particle, Sprite>();
+    }
+
+    two::SystemAccess access() const override {
+        return two::SystemAccess()
+            .read<Emitter>()
+            .write<Transform, Particle, Sprite>();
+    }
+
     void update(two::World *world, float dt) override {
         auto &emitter = world->unpack_one<Emitter>();
-        world->each<Transform, Particle, Sprite>(
+        particles.each(
             [&](two::Entity entity, Transform &tf, Particle &p, Sprite &sp) {
                 tf.position = tf.position + p.velocity * dt;
                 p.lifetime -= dt;
@@ -135,6 +145,9 @@ public:
                 }
             });
     }
+
+private:
+    two::Group<Transform, Particle, Sprite> particles;
 };
 
 class SpriteRenderer : public two::System {
@@ -143,6 +156,9 @@ public:
         SDL_SetRenderDrawBlendMode(gfx, SDL_BLENDMODE_BLEND);
     }
 
+    // Only draws, which is not scheduled
+    two::SystemAccess access() const override { return two::SystemAccess(); }
+
     void draw(two::World *world) override {
         SDL_SetRenderDrawColor(gfx, 0, 0, 0, 255);
         SDL_RenderClear(gfx);
@@ -167,6 +183,10 @@ public:
 
 class MoveSystem : public two::System {
 public:
+    two::SystemAccess access() const override {
+        return two::SystemAccess().write<Emitter>();
+    }
+
     void update(two::World *world, float) override {
         int x, y;
         SDL_GetMouseState(&x, &y);
@@ -194,9 +214,10 @@ public:
     }
 
     void update(float dt) override {
-        for (auto *system : systems()) {
-            system->update(this, dt);
-        }
+        // Schedule the systems for this frame and wait on the frame job,
+        // systems that do not conflict update at the same time.
+        auto frame = schedule_systems(dt);
+        get_thread_pool()->wait(frame);
     }
 
     bool keydown(const KeyDown &event) {
@@ -2,9 +2,8 @@
 
 #include "benchmark/benchmark.h"
 
-// With this many entities the World must be heap allocated
+// 64 bit entities are needed to address more than 64k entities
 #define TWO_ENTITY_64
-#define TWO_ENTITY_MAX ((1024<<10) + 1)
 #include "../entity.h"
 
 // Some dummy components
@@ -13,6 +12,19 @@ struct B { int64_t data; };
 struct C { int64_t data; };
 struct D { int64_t data; };
 
+// A wide component where a system only touches a few fields
+struct Body { float x, y, z, vx, vy, vz, mass, radius; };
+struct SoaBody { float x, y, z, vx, vy, vz, mass, radius; };
+
+namespace two {
+template <>
+struct SoaLayout<SoaBody> : SoaFields<
+    TWO_SOA_FIELD(SoaBody, x), TWO_SOA_FIELD(SoaBody, y),
+    TWO_SOA_FIELD(SoaBody, z), TWO_SOA_FIELD(SoaBody, vx),
+    TWO_SOA_FIELD(SoaBody, vy), TWO_SOA_FIELD(SoaBody, vz),
+    TWO_SOA_FIELD(SoaBody, mass), TWO_SOA_FIELD(SoaBody, radius)> {};
+}
+
 template <typename... Components>
 static void make_entities(const std::unique_ptr<two::World> &world, int n) {
     for (int i = 0; i < n; ++i) {
@@ -55,6 +67,27 @@ BENCHMARK_TEMPLATE(BM_IterateAndUnpack, A, B, C, D)
     ->Range(256, 1024<<10)
     ->Unit(benchmark::kMillisecond);
 
+template <typename... Components>
+static void BM_IterateView(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<Components...>(world, state.range(0));
+    auto view = world->make_view<Components...>();
+
+    for (auto _ : state) {
+        for (auto entity : view) {
+            TWO_TEMPLATE_FOLD(benchmark::DoNotOptimize(
+                view.template unpack<Components>(entity)));
+        }
+    }
+}
+BENCHMARK_TEMPLATE(BM_IterateView, A)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
+BENCHMARK_TEMPLATE(BM_IterateView, A, B, C, D)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
 static void BM_IterateLambda1(benchmark::State &state) {
     std::unique_ptr<two::World> world(new two::World);
     make_entities<A>(world, state.range(0));
@@ -86,6 +119,152 @@ BENCHMARK(BM_IterateLambda2)
     ->Range(256, 1024<<10)
     ->Unit(benchmark::kMillisecond);
 
+static void BM_UpdateLambda2(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<A, B>(world, state.range(0));
+    world->view<A, B>();
+
+    for (auto _ : state) {
+        world->each<A, B>([](A &a, B &b) {
+            a.data += b.data;
+        });
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_UpdateLambda2)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_ParUpdateLambda2(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    two::ThreadPool pool(state.range(1));
+    world->set_thread_pool(&pool);
+    make_entities<A, B>(world, state.range(0));
+    world->view<A, B>();
+
+    for (auto _ : state) {
+        world->par_each<A, B>([](A &a, B &b) {
+            a.data += b.data;
+        });
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_ParUpdateLambda2)
+    ->Args({1024<<10, 1})
+    ->Args({1024<<10, 2})
+    ->Args({1024<<10, 4})
+    ->Args({1024<<10, 8})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_ScheduleJobs(benchmark::State &state) {
+    two::ThreadPool pool(state.range(1));
+    for (auto _ : state) {
+        auto root = pool.make_job([] {});
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            pool.schedule(pool.make_job([] {}, root));
+        }
+        pool.schedule(root);
+        pool.wait(root);
+    }
+}
+BENCHMARK(BM_ScheduleJobs)
+    ->Args({4<<10, 1})
+    ->Args({4<<10, 4})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_UpdateChunk2(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<A, B>(world, state.range(0));
+#ifndef TWO_STORAGE_ARCHETYPE
+    world->group<A, B>();
+#endif
+
+    for (auto _ : state) {
+        world->each_chunk<A, B>([](size_t n, A *a, B *b) {
+            for (size_t i = 0; i < n; ++i) a[i].data += b[i].data;
+        });
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_UpdateChunk2)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_IterateLambda4(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<A, B, C, D>(world, state.range(0));
+    world->view<A, B, C, D>();
+
+    for (auto _ : state) {
+        world->each<A, B, C, D>([](A &a, B &b, C &c, D &d) {
+            benchmark::DoNotOptimize(a);
+            benchmark::DoNotOptimize(b);
+            benchmark::DoNotOptimize(c);
+            benchmark::DoNotOptimize(d);
+        });
+    }
+}
+BENCHMARK(BM_IterateLambda4)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
+#ifndef TWO_STORAGE_ARCHETYPE
+static void BM_IterateGroup4(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<A, B, C, D>(world, state.range(0));
+    auto group = world->group<A, B, C, D>();
+
+    for (auto _ : state) {
+        group.each([](A &a, B &b, C &c, D &d) {
+            benchmark::DoNotOptimize(a);
+            benchmark::DoNotOptimize(b);
+            benchmark::DoNotOptimize(c);
+            benchmark::DoNotOptimize(d);
+        });
+    }
+}
+BENCHMARK(BM_IterateGroup4)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+#endif
+
+static void BM_UpdateFieldAos(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<Body>(world, state.range(0));
+    world->view<Body>();
+
+    for (auto _ : state) {
+        world->each<Body>([](Body &b) {
+            b.x += b.vx * 0.016f;
+        });
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_UpdateFieldAos)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+
+#ifndef TWO_STORAGE_ARCHETYPE
+static void BM_UpdateFieldSoa(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_entities<SoaBody>(world, state.range(0));
+
+    for (auto _ : state) {
+        world->each_fields<SoaBody>([](size_t n, float *x, float *, float *,
+                                       float *vx, float *, float *,
+                                       float *, float *) {
+            for (size_t i = 0; i < n; ++i) x[i] += vx[i] * 0.016f;
+        });
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_UpdateFieldSoa)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
+#endif
+
 template <typename... Components>
 static void BM_View(benchmark::State &state) {
     std::unique_ptr<two::World> world(new two::World);
@@ -139,6 +318,127 @@ BENCHMARK(BM_CreateEntityAndPack)
     ->Range(256, 32<<10)
     ->Unit(benchmark::kMillisecond);
 
+// Views that have to be updated as components are added
+static void make_views(std::unique_ptr<two::World> &world) {
+    world->view<A>();
+    world->view<A, B>();
+    world->view<A, B, C>();
+    world->view<B, C>();
+}
+
+static void BM_CreateEntityAndPack3(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_views(world);
+    for (auto _ : state) {
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            auto entity = world->make_entity();
+            world->pack(entity, A{}, B{}, C{});
+        }
+        state.PauseTiming();
+        destroy_entities(world);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_CreateEntityAndPack3)
+    ->Range(256, 32<<10)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_PlaybackCommands3(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    make_views(world);
+    for (auto _ : state) {
+        auto &commands = world->commands();
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            auto entity = commands.make_entity();
+            commands.pack(entity, A{}, B{}, C{});
+        }
+        world->playback_commands();
+        state.PauseTiming();
+        destroy_entities(world);
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_PlaybackCommands3)
+    ->Range(256, 32<<10)
+    ->Unit(benchmark::kMillisecond);
+
+// Each emitter spawns entities from `par_each` through command buffers
+static void BM_ParSpawn(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    two::ThreadPool pool(state.range(1));
+    world->set_thread_pool(&pool);
+    make_entities<A>(world, 1024);
+    auto &world_ref = *world;
+
+    for (auto _ : state) {
+        world->par_each<A>([&world_ref, &state](const A &) {
+            auto &commands = world_ref.commands();
+            for (int64_t i = 0; i < state.range(0); ++i) {
+                commands.pack(commands.make_entity(), B{});
+            }
+        });
+        world->playback_commands();
+
+        state.PauseTiming();
+        for (auto entity : world->view<B>()) {
+            world->destroy_entity(entity);
+        }
+        world->collect_unused_entities();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_ParSpawn)
+    ->Args({16, 1})
+    ->Args({16, 2})
+    ->Args({16, 4})
+    ->Args({16, 8})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_DestroyEntities(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    for (auto _ : state) {
+        state.PauseTiming();
+        make_entities<A>(world, state.range(0));
+        state.ResumeTiming();
+
+        // Destroy in creation order, so each entity is never at the
+        // back of the entity list.
+        auto entities = world->unsafe_view_all();
+        for (auto entity : entities) {
+            if (entity != two::NullEntity)
+                world->destroy_entity(entity);
+        }
+        world->collect_unused_entities();
+    }
+}
+BENCHMARK(BM_DestroyEntities)
+    ->Range(256, 32<<10)
+    ->Unit(benchmark::kMillisecond);
+
+static void BM_RemoveFromView(benchmark::State &state) {
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::unique_ptr<two::World> world(new two::World);
+        make_entities<A>(world, state.range(0));
+        auto entities = world->view<A>();
+        state.ResumeTiming();
+
+        // Remove every other entity from the view and rebuild it
+        for (size_t i = 0; i < entities.size(); i += 2) {
+            world->remove<A>(entities[i]);
+        }
+        benchmark::DoNotOptimize(world->view<A>().data());
+
+        state.PauseTiming();
+        world.reset();
+        state.ResumeTiming();
+    }
+}
+BENCHMARK(BM_RemoveFromView)
+    ->Range(256, 256<<10)
+    ->Unit(benchmark::kMillisecond);
+
 static void BM_EmitEvent2(benchmark::State &state) {
     std::unique_ptr<two::World> world(new two::World);
     world->bind<A>([](const A &event) {
@@ -159,3 +459,25 @@ static void BM_EmitEvent2(benchmark::State &state) {
 BENCHMARK(BM_EmitEvent2)
     ->Range(256, 1024<<10)
     ->Unit(benchmark::kMillisecond);
+
+static void BM_DispatchEvents2(benchmark::State &state) {
+    std::unique_ptr<two::World> world(new two::World);
+    world->bind<A>([](const A &event) {
+        benchmark::DoNotOptimize(event);
+        return true;
+    });
+    world->bind<B>([](const B &event) {
+        benchmark::DoNotOptimize(event);
+        return true;
+    });
+    for (auto _ : state) {
+        for (int64_t i = 0; i < state.range(0); ++i) {
+            world->enqueue(A{12});
+            world->enqueue(B{24});
+        }
+        world->dispatch_events();
+    }
+}
+BENCHMARK(BM_DispatchEvents2)
+    ->Range(256, 1024<<10)
+    ->Unit(benchmark::kMillisecond);
@@ -1,5 +1,8 @@
 #include "gtest/gtest.h"
 
+#include <memory>
+#include <mutex>
+
 #define TWO_ASSERTIONS
 #define TWO_PARANOIA
 #include "../entity.h"
@@ -9,9 +12,63 @@ struct B { int data; };
 struct C { int data; };
 struct D { int data; };
 
+struct MoveOnly {
+    std::unique_ptr<int> data;
+};
+
+struct CopyCounter {
+    static int copies;
+    int data = 0;
+    CopyCounter() = default;
+    CopyCounter(const CopyCounter &other) : data{other.data} { ++copies; }
+    CopyCounter(CopyCounter &&) = default;
+    CopyCounter &operator=(const CopyCounter &other) {
+        data = other.data;
+        ++copies;
+        return *this;
+    }
+    CopyCounter &operator=(CopyCounter &&) = default;
+};
+int CopyCounter::copies = 0;
+
 class SystemA : public two::System {};
 class SystemB : public two::System {};
 
+TEST(ECS_ComponentArray, PackedEntities) {
+    two::ComponentArray<A> array;
+    array.write(1, A{1});
+    array.write(2, A{2});
+    array.write(3, A{3});
+    ASSERT_EQ(3, array.entities().size());
+    EXPECT_EQ(1, array.entities()[0]);
+
+    // The last component is moved into the removed slot
+    EXPECT_TRUE(array.remove(1));
+    ASSERT_EQ(2, array.count());
+    ASSERT_EQ(2, array.entities().size());
+    EXPECT_EQ(3, array.entities()[0]);
+    EXPECT_EQ(2, array.entities()[1]);
+    EXPECT_EQ(3, array.read(3).data);
+    EXPECT_FALSE(array.contains(1));
+    EXPECT_FALSE(array.remove(1));
+}
+
+TEST(ECS_World, ComponentIndex) {
+    EXPECT_EQ(two::component_index<A>(), two::component_index<A>());
+    EXPECT_EQ(two::component_index<A>(), two::component_index<const A &>());
+    EXPECT_NE(two::component_index<A>(), two::component_index<B>());
+
+    // Worlds registering components in a different order agree on the
+    // component indices.
+    two::World w0, w1;
+    auto e0 = w0.make_entity();
+    auto e1 = w1.make_entity();
+    w0.pack(e0, C{}, D{});
+    w1.pack(e1, D{}, C{});
+    EXPECT_EQ(w0.get_mask(e0), w1.get_mask(e1));
+    EXPECT_FALSE(w0.contains<struct Unregistered>(e0));
+}
+
 TEST(ECS_World, MakeEntity) {
     two::World world;
     auto entity = world.make_entity();
@@ -22,6 +79,19 @@ TEST(ECS_World, MakeEntity) {
     EXPECT_EQ(2, world.unsafe_view_all().size());
 }
 
+TEST(ECS_World, EmptyWorldMask) {
+    two::World world;
+    EXPECT_FALSE(world.contains<A>(two::NullEntity));
+    EXPECT_TRUE(world.get_mask(two::NullEntity).none());
+
+    // Masks do not move when new pages are allocated
+    auto entity = world.make_entity();
+    const auto &mask = world.get_mask(entity);
+    for (int i = 0; i < 10000; ++i) world.make_entity();
+    EXPECT_EQ(&mask, &world.get_mask(entity));
+    EXPECT_TRUE(mask.test(two::component_index<two::Active>()));
+}
+
 TEST(ECS_World, ComponentOperations) {
     two::World world;
     auto entity = world.make_entity();
@@ -30,7 +100,13 @@ TEST(ECS_World, ComponentOperations) {
     EXPECT_TRUE((world.contains<A, B, C>(entity)));
 
     auto &a1 = world.unpack<A>(entity);
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Packing B and C moved A to another table
+    (void)a0;
+    ASSERT_EQ(&a1, &world.unpack<A>(entity));
+#else
     ASSERT_EQ(&a0, &a1);
+#endif
 
     world.remove<A>(entity);
     EXPECT_FALSE(world.contains<A>(entity));
@@ -45,6 +121,175 @@ TEST(ECS_World, ComponentOperations) {
     EXPECT_TRUE(world.contains<two::Active>(entity));
 }
 
+TEST(ECS_World, MoveOnlyComponents) {
+    two::World world;
+    auto e0 = world.make_entity();
+    auto e1 = world.make_entity();
+    world.pack(e0, MoveOnly{std::unique_ptr<int>(new int(1))});
+    world.pack(e1, MoveOnly{std::unique_ptr<int>(new int(2))}, A{});
+
+    // Removing e0 moves e1's component into its slot
+    world.remove<MoveOnly>(e0);
+    EXPECT_FALSE(world.contains<MoveOnly>(e0));
+    EXPECT_EQ(2, *world.unpack<MoveOnly>(e1).data);
+
+    MoveOnly m{std::unique_ptr<int>(new int(3))};
+    world.pack(e1, std::move(m));
+    EXPECT_EQ(3, *world.unpack<MoveOnly>(e1).data);
+    world.destroy_entity(e1);
+}
+
+TEST(ECS_World, PackMovesComponents) {
+    two::World world;
+    auto e0 = world.make_entity();
+    auto e1 = world.make_entity();
+    CopyCounter::copies = 0;
+    world.pack(e0, CopyCounter{});
+    world.pack(e1, CopyCounter{}, A{});
+    world.pack(e0, CopyCounter{});
+    world.remove<CopyCounter>(e0);
+    EXPECT_EQ(0, CopyCounter::copies);
+
+    CopyCounter c;
+    world.pack(e0, c);
+    EXPECT_EQ(1, CopyCounter::copies);
+}
+
+struct Inventory {
+    std::vector<int> items;
+    int gold;
+    Inventory(size_t capacity, int gold) : items(capacity), gold{gold} {}
+};
+
+TEST(ECS_World, Emplace) {
+    two::World world;
+    auto entity = world.make_entity();
+    auto view = world.make_view<Inventory>();
+
+    CopyCounter::copies = 0;
+    world.emplace<CopyCounter>(entity);
+    EXPECT_EQ(0, CopyCounter::copies);
+
+    auto &inventory = world.emplace<Inventory>(entity, 16, 100);
+    EXPECT_EQ(16, inventory.items.size());
+    EXPECT_EQ(100, inventory.gold);
+    EXPECT_EQ(1, view.size());
+
+    // Replaces the existing component
+    world.emplace<Inventory>(entity, 4, 50);
+    EXPECT_EQ(4, world.unpack<Inventory>(entity).items.size());
+    EXPECT_EQ(1, view.size());
+
+    // Aggregates are brace initialized
+    EXPECT_EQ(12, world.emplace<A>(entity, 12).data);
+}
+
+struct Tag {};
+
+TEST(ECS_World, TagComponents) {
+    EXPECT_TRUE((std::is_same<two::TagArray<Tag>,
+                              two::ComponentStorage<Tag>>()));
+    EXPECT_TRUE((std::is_same<two::TagArray<two::Active>,
+                              two::ComponentStorage<two::Active>>()));
+
+    two::World world;
+    auto e0 = world.make_entity();
+    auto e1 = world.make_entity();
+    world.pack(e0, Tag{}, A{1});
+    world.pack(e1, A{2});
+    EXPECT_TRUE(world.contains<Tag>(e0));
+    EXPECT_FALSE(world.contains<Tag>(e1));
+
+    int count = 0;
+    world.each<A, Tag>([&](two::Entity entity, A &a, Tag &) {
+        EXPECT_EQ(e0, entity);
+        EXPECT_EQ(1, a.data);
+        ++count;
+    });
+    EXPECT_EQ(1, count);
+
+    auto e2 = world.make_entity(e0);
+    EXPECT_TRUE(world.contains<Tag>(e2));
+    EXPECT_EQ(2, world.view<Tag>().size());
+
+    world.remove<Tag>(e0);
+    EXPECT_FALSE(world.contains<Tag>(e0));
+    EXPECT_EQ(1, world.view<Tag>().size());
+    EXPECT_DEBUG_DEATH(world.unpack<Tag>(e0), "");
+
+    // Removing a tag that has already been removed is a no-op.
+    world.remove<Tag>(e0);
+    EXPECT_EQ(1, world.view<Tag>().size());
+}
+
+struct Position {
+    float x, y;
+    int unused;
+};
+
+namespace two {
+template <>
+struct SoaLayout<Position> : SoaFields<
+    TWO_SOA_FIELD(Position, x), TWO_SOA_FIELD(Position, y)> {};
+}
+
+#ifndef TWO_STORAGE_ARCHETYPE
+TEST(ECS_World, SoaComponents) {
+    EXPECT_TRUE((std::is_same<two::SoaArray<Position>,
+                              two::ComponentStorage<Position>>()));
+
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, Position{float(i), float(i * 2), 1}, A{i});
+        entities.push_back(entity);
+    }
+    auto p = world.unpack<Position>(entities[3]);
+    EXPECT_EQ(3.f, p.get().x);
+    EXPECT_EQ(6.f, p.field<1>());
+    // Only fields in the layout are stored
+    EXPECT_EQ(0, p.get().unused);
+
+    p.field<0>() = 10.f;
+    EXPECT_EQ(10.f, world.unpack<Position>(entities[3]).get().x);
+    world.unpack<Position>(entities[4]) = Position{-1.f, -2.f, 0};
+    EXPECT_EQ(-2.f, world.unpack<Position>(entities[4]).get().y);
+
+    world.each<A, Position>([](A &a, two::SoaRef<Position> p) {
+        p.field<1>() = float(a.data);
+    });
+    world.each_fields<Position>([](size_t n, float *x, float *y) {
+        EXPECT_EQ(8, n);
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(x) % TWO_SOA_ALIGNMENT);
+        EXPECT_EQ(0, reinterpret_cast<uintptr_t>(y) % TWO_SOA_ALIGNMENT);
+        for (size_t i = 0; i < n; ++i) {
+            x[i] = y[i] + 1.f;
+        }
+    });
+    for (int i = 0; i < 8; ++i) {
+        Position pos = world.unpack<Position>(entities[i]);
+        EXPECT_EQ(float(i), pos.y);
+        EXPECT_EQ(float(i + 1), pos.x);
+    }
+
+    world.remove<Position>(entities[0]);
+    world.destroy_entity(entities[1]);
+    auto copy = world.make_entity(entities[7]);
+    EXPECT_EQ(8.f, world.unpack<Position>(copy).get().x);
+    EXPECT_FALSE(world.contains<Position>(entities[0]));
+    EXPECT_EQ(7, world.view<Position>().size());
+
+    int count = 0;
+    world.each_fields<Position>([&count](size_t n, float *, float *) {
+        count = int(n);
+    });
+    EXPECT_EQ(7, count);
+    Position last = world.unpack<Position>(entities[7]);
+    EXPECT_EQ(7.f, last.y);
+}
+#endif
+
 TEST(ECS_World, EntityArchetype) {
     two::World world;
     // Archetypes don't need to be inactive, you can just
@@ -61,6 +306,32 @@ TEST(ECS_World, EntityArchetype) {
     EXPECT_EQ(32, world.unpack<C>(entity).data);
 }
 
+TEST(ECS_World, CopyMoveOnlyEntity) {
+    two::World world;
+    auto src = world.make_entity();
+    world.pack(src, A{1}, MoveOnly{std::unique_ptr<int>(new int(1))}, B{2});
+    auto other = world.make_entity();
+    world.pack(other, A{3}, MoveOnly{std::unique_ptr<int>(new int(3))}, B{4});
+
+    // Move only components are left out of the copy
+    auto dst = world.make_entity(src);
+    EXPECT_TRUE((world.contains<two::Active, A, B>(dst)));
+    EXPECT_FALSE(world.contains<MoveOnly>(dst));
+    EXPECT_EQ(1, world.unpack<A>(dst).data);
+    EXPECT_EQ(2, world.unpack<B>(dst).data);
+
+    int count = 0;
+    world.each<A, MoveOnly, B>([&](A &a, MoveOnly &m, B &b) {
+        EXPECT_EQ(a.data, *m.data);
+        EXPECT_EQ(a.data + 1, b.data);
+        ++count;
+    });
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(3, (world.view<A, B>().size()));
+    EXPECT_EQ(3, *world.unpack<MoveOnly>(other).data);
+    EXPECT_EQ(4, world.unpack<B>(other).data);
+}
+
 TEST(ECS_World, EntityReuse) {
     two::World world;
     auto e0 = world.make_entity();
@@ -74,7 +345,60 @@ TEST(ECS_World, EntityReuse) {
     EXPECT_EQ(two::entity_index(e0), two::entity_index(e1));
     EXPECT_NE(e0, e1);
     EXPECT_EQ(1, two::entity_version(e1));
+    EXPECT_FALSE(world.contains<A>(e1));
     EXPECT_DEBUG_DEATH(world.unpack<A>(e1), "");
+    world.pack(e1, A{});
+    EXPECT_TRUE(world.contains<A>(e1));
+}
+
+TEST(ECS_World, ManyEntities) {
+    two::World world;
+    // Spans multiple pages of entity storage
+    for (int i = 0; i < 10000; ++i) {
+        world.pack(world.make_entity(), A{i});
+    }
+    EXPECT_EQ(10000, world.view<A>().size());
+    for (auto entity : world.view<A>()) {
+        EXPECT_TRUE(world.contains<A>(entity));
+        EXPECT_FALSE(world.contains<B>(entity));
+    }
+}
+
+TEST(ECS_World, DestroyEntity) {
+    two::World world;
+    auto e0 = world.make_entity();
+    auto e1 = world.make_entity();
+    auto e2 = world.make_entity();
+    world.destroy_entity(e0);
+    world.destroy_entity(e2);
+
+    auto &all = world.unsafe_view_all();
+    ASSERT_EQ(2, all.size());
+    EXPECT_NE(std::find(all.begin(), all.end(), e1), all.end());
+
+    world.collect_unused_entities();
+    auto e3 = world.make_entity();
+    world.destroy_entity(e1);
+    ASSERT_EQ(2, all.size());
+    EXPECT_NE(std::find(all.begin(), all.end(), e3), all.end());
+}
+
+TEST(ECS_World, ViewEntityReuse) {
+    two::World world;
+    auto e0 = world.make_entity();
+    world.pack(e0, A{});
+    EXPECT_EQ(1, world.view<A>().size());
+    world.destroy_entity(e0);
+    world.collect_unused_entities();
+
+    // The new entity has the same index as e0 but must not be
+    // considered part of the view until it has an A component.
+    auto e1 = world.make_entity();
+    ASSERT_EQ(two::entity_index(e0), two::entity_index(e1));
+    EXPECT_EQ(0, world.view<A>().size());
+    world.pack(e1, A{});
+    ASSERT_EQ(1, world.view<A>().size());
+    EXPECT_EQ(e1, world.view<A>()[0]);
 }
 
 TEST(ECS_World, View) {
@@ -111,6 +435,80 @@ TEST(ECS_World, View) {
     EXPECT_EQ(1, world.view<A>().size());
 }
 
+TEST(ECS_World, ViewPendingDiffs) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        entities.push_back(entity);
+    }
+    EXPECT_EQ(8, world.view<A>().size());
+
+    // Changes made before the view is rebuilt are applied in order
+    world.remove<A>(entities[0]);
+    world.pack(entities[0], A{});
+    world.remove<A>(entities[1]);
+    world.destroy_entity(entities[2]);
+    world.remove<A>(entities[7]);
+
+    auto &v = world.view<A>();
+    EXPECT_EQ(5, v.size());
+    for (size_t i = 0; i < entities.size(); ++i) {
+        bool found = std::find(v.begin(), v.end(), entities[i]) != v.end();
+        EXPECT_EQ(i != 1 && i != 2 && i != 7, found);
+    }
+}
+
+TEST(ECS_World, ViewExclude) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i}, B{i});
+        if (i % 2 == 0) world.pack(entity, C{i});
+        entities.push_back(entity);
+    }
+    auto &initial = world.view<A, B>(two::exclude<C>());
+    EXPECT_EQ(4, initial.size());
+    for (auto entity : world.view<A, B>(two::exclude<C>())) {
+        EXPECT_FALSE(world.contains<C>(entity));
+    }
+
+    // Removing an excluded component adds the entity to the view
+    world.remove<C>(entities[0]);
+    // Packing an excluded component removes the entity from the view
+    world.pack(entities[1], C{});
+    // Removing an included component removes the entity from the view
+    world.remove<B>(entities[3]);
+
+    auto &v = world.view<A, B>(two::exclude<C>());
+    EXPECT_EQ(3, v.size());
+    for (size_t i = 0; i < entities.size(); ++i) {
+        bool found = std::find(v.begin(), v.end(), entities[i]) != v.end();
+        EXPECT_EQ(i == 0 || i == 5 || i == 7, found);
+    }
+    EXPECT_EQ(8 - 1, (world.view<A, B>().size()));
+
+    int sum = 0;
+    world.each<A, B>([&sum](A &a, B &) {
+        sum += a.data;
+    }, two::exclude<C>());
+    EXPECT_EQ(0 + 5 + 7, sum);
+
+    auto copy = world.make_entity();
+    world.pack(copy, C{});
+    world.copy_entity(copy, entities[5]);
+    auto view = world.make_view<A, B>(two::exclude<C>());
+    auto has_copy = [&view, copy]() {
+        auto &e = view.entities();
+        return std::find(e.begin(), e.end(), copy) != e.end();
+    };
+    EXPECT_FALSE(has_copy());
+    world.remove<C>(copy);
+    EXPECT_TRUE(has_copy());
+}
+
 TEST(ECS_World, ViewEach) {
     two::World world;
     auto e0 = world.make_entity();
@@ -127,7 +525,740 @@ TEST(ECS_World, ViewEach) {
         EXPECT_EQ(24, b.data);
         a.data = 16;
     });
+#ifdef TWO_STORAGE_ARCHETYPE
+    // Packing B moved A to another table
+    (void)a;
+    EXPECT_EQ(16, world.unpack<A>(e0).data);
+#else
     EXPECT_EQ(16, a.data);
+#endif
+}
+
+struct SumA {
+    int sum = 0;
+    void operator()(A &a) { sum += a.data; }
+};
+
+TEST(ECS_World, ViewEachMaybe) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i * 10});
+        entities.push_back(entity);
+    }
+
+    int count = 0, with_b = 0;
+    world.each<A, two::Maybe<B>>([&](two::Entity entity, A &a, B *b) {
+        ++count;
+        if (b == nullptr) {
+            EXPECT_FALSE(world.contains<B>(entity));
+            return;
+        }
+        ++with_b;
+        EXPECT_EQ(a.data * 10, b->data);
+        b->data = -1;
+    });
+    EXPECT_EQ(8, count);
+    EXPECT_EQ(4, with_b);
+    EXPECT_EQ(-1, world.unpack<B>(entities[0]).data);
+
+    // Optional component that was never packed
+    count = 0;
+    world.each<two::Maybe<C>, A>([&count](C *c, A &) {
+        EXPECT_EQ(nullptr, c);
+        ++count;
+    });
+    EXPECT_EQ(8, count);
+
+    auto view = world.make_view<A, two::Maybe<B>>();
+    EXPECT_EQ(8, view.size());
+}
+
+TEST(ECS_World, ViewEachMixedMasks) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 16; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        if (i % 4 == 0) world.pack(entity, C{i});
+        if (i % 3 == 0) world.set_active(entity, false);
+        entities.push_back(entity);
+    }
+    int sum = 0;
+    world.each<A, B>([&sum](A &a, B &b) {
+        EXPECT_EQ(a.data, b.data);
+        sum += a.data;
+    });
+    // Even and not a multiple of 3
+    EXPECT_EQ(2 + 4 + 8 + 10 + 14, sum);
+
+    // Removing the current entity's components while iterating
+    int count = 0;
+    world.each<A, B>([&](two::Entity entity, A &, B &) {
+        world.remove<B>(entity);
+        ++count;
+    }, true);
+    EXPECT_EQ(8, count);
+    EXPECT_EQ(0, (world.view<A, B>(true).size()));
+
+    count = 0;
+    world.each<A, C>([&](two::Entity entity, A &, C &) {
+        world.destroy_entity(entity);
+        ++count;
+    });
+    EXPECT_EQ(2, count);
+    EXPECT_EQ(0, (world.view<A, C>().size()));
+    EXPECT_EQ(2, world.view<C>(true).size());
+}
+
+TEST(ECS_World, EachWithoutComponents) {
+    two::World world;
+    // With TWO_STORAGE_ARCHETYPE entities without components are not in
+    // any table, `each` must still visit them like the view does.
+    world.make_inactive_entity();
+    world.make_entity();
+    world.pack(world.make_entity(), A{1});
+    world.pack(world.make_inactive_entity(), A{2});
+
+    auto view = world.view<>(true);
+    std::sort(view.begin(), view.end());
+    ASSERT_EQ(4, view.size());
+
+    std::vector<two::Entity> visited;
+    world.each<>([&](two::Entity entity) { visited.push_back(entity); },
+                 true);
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(view, visited);
+
+    visited.clear();
+    world.make_view<>(true).each([&](two::Entity entity) {
+        visited.push_back(entity);
+    });
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(view, visited);
+
+    visited.clear();
+    world.each<two::Maybe<A>>([&](two::Entity entity, A *) {
+        visited.push_back(entity);
+    }, true);
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(view, visited);
+
+    visited.clear();
+    std::mutex mutex;
+    world.par_each<>([&](two::Entity entity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        visited.push_back(entity);
+    }, true);
+    std::sort(visited.begin(), visited.end());
+    EXPECT_EQ(view, visited);
+}
+
+#ifndef TWO_STORAGE_ARCHETYPE
+// Checks that the first `size()` components of each array belong to the
+// entities in the group.
+template <typename... Components>
+static void expect_group_packed(two::World &world,
+                                two::Group<Components...> &group) {
+    for (size_t i = 0; i < group.size(); ++i) {
+        auto entity = group.entities()[i];
+        EXPECT_TRUE((world.contains<Components...>(entity)));
+        EXPECT_TRUE(world.contains<two::Active>(entity));
+        EXPECT_EQ(&world.unpack<A>(entity), &group.template data<A>()[i]);
+        EXPECT_EQ(&world.unpack<B>(entity), &group.template data<B>()[i]);
+    }
+}
+
+TEST(ECS_World, Group) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 16; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        entities.push_back(entity);
+    }
+    auto group = world.group<A, B>();
+    EXPECT_EQ(8, group.size());
+    expect_group_packed(world, group);
+
+    // Same components return the same group
+    EXPECT_EQ(8, (world.group<A, B>().size()));
+
+    world.pack(entities[1], B{1});
+    world.remove<B>(entities[0]);
+    world.remove<A>(entities[2]);
+    world.destroy_entity(entities[4]);
+    world.set_active(entities[6], false);
+    world.pack(world.make_entity(), A{100}, B{100});
+    EXPECT_EQ(8 + 1 - 4 + 1, group.size());
+    expect_group_packed(world, group);
+
+    auto copy = world.make_entity();
+    world.copy_entity(copy, entities[8]);
+    EXPECT_EQ(7, group.size());
+    expect_group_packed(world, group);
+
+    int sum = 0;
+    group.each([&](two::Entity entity, A &a, B &b) {
+        EXPECT_EQ(&world.unpack<A>(entity), &a);
+        EXPECT_EQ(a.data, b.data);
+        sum += a.data;
+        // Removing components of the current entity while iterating
+        if (a.data == 100) world.remove<A>(entity);
+    });
+    EXPECT_EQ(1 + 8 + 8 + 10 + 12 + 14 + 100, sum);
+    EXPECT_EQ(6, group.size());
+    expect_group_packed(world, group);
+
+    // Iterating the group's components with each still works
+    sum = 0;
+    world.each<B, A>([&sum](B &b, A &) { sum += b.data; });
+    EXPECT_EQ(1 + 8 + 8 + 10 + 12 + 14, sum);
+
+    EXPECT_TRUE(group);
+    EXPECT_FALSE(two::Group<A>());
+}
+
+TEST(ECS_World, OverlappingGroups) {
+    two::World world;
+    for (int i = 0; i < 16; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        if (i % 3 == 0) world.pack(entity, C{i});
+    }
+    auto ab = world.group<A, B>();
+    ASSERT_TRUE(ab);
+
+    // A is already owned, so no group is created
+    auto ac = world.group<A, C>();
+    EXPECT_FALSE(ac);
+    EXPECT_EQ(0, ac.size());
+    EXPECT_FALSE(world.group<A>());
+    EXPECT_FALSE((world.group<A, B>(true)));
+    EXPECT_FALSE((world.group<C, B>()));
+
+    // C is not owned by the failed groups
+    auto c = world.group<C>();
+    EXPECT_TRUE(c);
+    EXPECT_EQ(6, c.size());
+
+    world.pack(world.make_entity(), A{20}, B{20}, C{20});
+    EXPECT_EQ(9, ab.size());
+    expect_group_packed(world, ab);
+    ab.each([](A &a, B &b) { EXPECT_EQ(a.data, b.data); });
+    EXPECT_EQ(7, c.size());
+    c.each([&world](two::Entity entity, C &component) {
+        EXPECT_EQ(&world.unpack<C>(entity), &component);
+    });
+}
+#endif
+
+TEST(ECS_World, EachChunk) {
+    two::World world;
+    for (int i = 0; i < 16; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        if (i % 4 == 0) world.pack(entity, C{i});
+        if (i == 6) world.set_active(entity, false);
+    }
+    int count = 0;
+    int sum = 0;
+    world.each_chunk<A, B>([&](size_t n, A *a, B *b) {
+        EXPECT_GT(n, 0);
+        for (size_t i = 0; i < n; ++i) {
+            EXPECT_EQ(a[i].data, b[i].data);
+            a[i].data += b[i].data;
+            sum += b[i].data;
+            ++count;
+        }
+    });
+    EXPECT_EQ(7, count);
+    EXPECT_EQ(0 + 2 + 4 + 8 + 10 + 12 + 14, sum);
+
+    sum = 0;
+    world.each<A, B>([&sum](A &a, B &) { sum += a.data; }, true);
+    EXPECT_EQ(2 * (0 + 2 + 4 + 8 + 10 + 12 + 14) + 6, sum);
+}
+
+#ifndef TWO_STORAGE_ARCHETYPE
+TEST(ECS_World, EachChunkGroup) {
+    two::World world;
+    for (int i = 0; i < 16; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        if (i % 4 == 0) world.pack(entity, C{i});
+    }
+    // Without a group every entity is its own chunk and no group is made.
+    int chunks = 0;
+    world.each_chunk<A, B>([&](size_t n, A *a, B *b) {
+        EXPECT_EQ(1u, n);
+        EXPECT_EQ(a->data, b->data);
+        ++chunks;
+    });
+    EXPECT_EQ(8, chunks);
+    chunks = 0;
+    world.each_chunk<A, C>([&](size_t n, A *a, C *c) {
+        EXPECT_EQ(1u, n);
+        EXPECT_EQ(a->data, c->data);
+        ++chunks;
+    });
+    EXPECT_EQ(4, chunks);
+
+    // With a group the components come in one chunk.
+    EXPECT_TRUE((world.group<A, C>()));
+    chunks = 0;
+    world.each_chunk<C, A>([&](size_t n, C *c, A *a) {
+        EXPECT_EQ(4u, n);
+        for (size_t i = 0; i < n; ++i) EXPECT_EQ(a[i].data, c[i].data);
+        ++chunks;
+    });
+    EXPECT_EQ(1, chunks);
+}
+#endif
+
+TEST(ECS_World, ParEach) {
+    two::World world;
+    two::ThreadPool pool(4);
+    world.set_thread_pool(&pool);
+    for (int i = 0; i < 10000; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i});
+        if (i % 2 == 0) world.pack(entity, B{i});
+        if (i % 3 == 0) world.set_active(entity, false);
+    }
+    world.par_each<A, B>([](A &a, B &b) { a.data += b.data; });
+
+    std::atomic<int> count{0};
+    world.par_each<A>([&](two::Entity entity, const A &a) {
+        if (world.contains<B, two::Active>(entity)) {
+            EXPECT_EQ(2 * world.unpack<B>(entity).data, a.data);
+        } else if (world.contains<B>(entity)) {
+            EXPECT_EQ(world.unpack<B>(entity).data, a.data);
+        }
+        ++count;
+    }, true);
+    EXPECT_EQ(10000, count);
+}
+
+TEST(ECS_ThreadPool, Jobs) {
+    for (size_t threads : {1, 4}) {
+        two::ThreadPool pool(threads);
+        std::atomic<int> count{0};
+        std::vector<int> order;
+        std::mutex mutex;
+        auto log = [&](int i) {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(i);
+        };
+
+        auto frame = pool.make_job([&] { log(0); });
+        two::Job a;
+        a = pool.make_job([&] {
+            // Children created by a running job, `a` is not finished until
+            // they finish
+            for (int i = 0; i < 100; ++i) {
+                pool.schedule(pool.make_job([&] { ++count; }, a));
+            }
+            log(1);
+        }, frame);
+        auto b = pool.make_job([&] { log(2); }, frame);
+        auto c = pool.make_job([&] {
+            EXPECT_EQ(100, count);
+            log(3);
+        }, frame);
+        pool.depends_on(b, a);
+        pool.depends_on(c, a);
+        pool.depends_on(c, b);
+        pool.schedule(c);
+        pool.schedule(b);
+        pool.schedule(a);
+        pool.schedule(frame);
+        pool.wait(frame);
+
+        EXPECT_TRUE(a.done() && b.done() && c.done() && frame.done());
+        EXPECT_EQ(100, count);
+        ASSERT_EQ(4, order.size());
+        // The frame job may run at any time
+        order.erase(std::find(order.begin(), order.end(), 0));
+        EXPECT_EQ((std::vector<int>{1, 2, 3}), order);
+
+        // Depending on a finished job does not wait
+        auto d = pool.make_job([&] { ++count; });
+        pool.depends_on(d, a);
+        pool.schedule(d);
+        pool.wait(d);
+        EXPECT_EQ(101, count);
+    }
+}
+
+TEST(ECS_ThreadPool, ReuseJobs) {
+    two::ThreadPool pool(4);
+    auto captured = std::make_shared<int>(0);
+    auto first = pool.make_job([captured] { ++*captured; });
+    pool.schedule(first);
+    pool.wait(first);
+    // The function is released once the job has run
+    EXPECT_EQ(1, *captured);
+    EXPECT_EQ(1, captured.use_count());
+
+    // Records of finished jobs are reused, but not while a handle is kept
+    std::atomic<int> count{0};
+    for (int i = 0; i < 100; ++i) {
+        auto root = pool.make_job([] {});
+        for (int j = 0; j < 10; ++j) {
+            pool.schedule(pool.make_job([&count] { ++count; }, root));
+        }
+        pool.schedule(root);
+        pool.wait(root);
+        EXPECT_TRUE(first.done());
+    }
+    EXPECT_EQ(1000, count);
+}
+
+TEST(ECS_ThreadPool, OtherPoolThread) {
+    two::ThreadPool a(2);
+    two::ThreadPool b(2);
+    EXPECT_FALSE(a.other_pool_thread());
+    std::atomic<int> other{-1};
+    auto job = b.make_job([&] {
+        other = a.other_pool_thread() && !b.other_pool_thread();
+    });
+    b.schedule(job);
+    // Not waiting with `wait`, so the job runs on the worker of `b`
+    while (!job.done()) std::this_thread::yield();
+    EXPECT_EQ(1, other);
+}
+
+TEST(ECS_ThreadPool, WaitForLongJob) {
+    two::ThreadPool pool(2);
+    std::atomic<int> count{0};
+    auto root = pool.make_job([] {});
+    for (int i = 0; i < 2; ++i) {
+        // One job runs on the worker while the waiting thread runs out of
+        // jobs and blocks until it is woken by the finished job.
+        pool.schedule(pool.make_job([&count] {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            ++count;
+        }, root));
+    }
+    pool.schedule(root);
+    pool.wait(root);
+    EXPECT_TRUE(root.done());
+    EXPECT_EQ(2, count);
+}
+
+TEST(ECS_ThreadPool, NestedRun) {
+    two::ThreadPool pool(4);
+    std::atomic<int> count{0};
+    pool.run(8, [&](size_t) {
+        pool.run(8, [&](size_t) { ++count; });
+    });
+    EXPECT_EQ(64, count);
+}
+
+TEST(ECS_World, ParEachStructuralChanges) {
+    two::World world;
+    two::ThreadPool pool(1);
+    world.set_thread_pool(&pool);
+    world.pack(world.make_entity(), A{1});
+
+    EXPECT_DEBUG_DEATH(world.par_each<A>([&](two::Entity entity, A &) {
+        world.remove<A>(entity);
+    }), "");
+    EXPECT_DEBUG_DEATH(world.par_each<A>([&](two::Entity, A &) {
+        world.make_entity();
+    }), "");
+}
+
+TEST(ECS_World, CommandBuffer) {
+    two::World world;
+    auto a = world.make_entity();
+    auto b = world.make_entity();
+    world.pack(a, A{1});
+    world.pack(b, A{2}, B{2});
+    EXPECT_EQ(2, world.view<A>().size());
+
+    two::CommandBuffer commands(&world);
+    auto c = commands.make_entity();
+    commands.pack(c, A{3}, MoveOnly{std::unique_ptr<int>(new int(3))});
+    commands.remove<A>(a);
+    commands.pack(a, A{4});
+    commands.remove<B>(b);
+    commands.destroy_entity(b);
+    EXPECT_FALSE(commands.empty());
+
+    // Nothing changes until the commands are played back
+    EXPECT_EQ(2, world.view<A>().size());
+    EXPECT_EQ(1, world.view<B>().size());
+    world.playback(commands);
+    EXPECT_TRUE(commands.empty());
+
+    EXPECT_TRUE(world.contains<two::Active>(c));
+    EXPECT_EQ(3, world.unpack<A>(c).data);
+    EXPECT_EQ(3, *world.unpack<MoveOnly>(c).data);
+    EXPECT_EQ(4, world.unpack<A>(a).data);
+    EXPECT_EQ(0, world.view<B>().size());
+    auto view = world.view<A>();
+    ASSERT_EQ(2, view.size());
+    EXPECT_EQ(a, view[0]);
+    EXPECT_EQ(c, view[1]);
+
+    // Discarded commands are not applied, but the entity is still created
+    auto d = commands.make_entity();
+    commands.pack(d, MoveOnly{std::unique_ptr<int>(new int(5))});
+    commands.clear();
+    world.playback(commands);
+    EXPECT_FALSE(world.contains<two::Active>(d));
+    EXPECT_FALSE(world.contains<MoveOnly>(d));
+    EXPECT_EQ(4, world.unsafe_view_all().size());
+
+    // Commands larger than a block
+    struct Large { char data[64 << 10]; };
+    std::unique_ptr<Large> large(new Large);
+    large->data[0] = 1;
+    commands.pack(a, *large);
+    world.playback(commands);
+    EXPECT_EQ(1, world.unpack<Large>(a).data[0]);
+}
+
+TEST(ECS_World, CommandsOnDestroyedEntity) {
+    two::World world;
+    auto entity = world.make_entity();
+    world.pack(entity, A{1});
+
+    // Recorded by different threads, the buffer that destroys the entity
+    // is played back first.
+    two::CommandBuffer first(&world);
+    two::CommandBuffer second(&world);
+    first.destroy_entity(entity);
+    second.pack(entity, B{2}, MoveOnly{std::unique_ptr<int>(new int(2))});
+    second.remove<A>(entity);
+    second.destroy_entity(entity);
+    world.playback(first);
+    world.playback(second);
+    EXPECT_EQ(0, world.view<A>().size());
+    EXPECT_EQ(0, world.view<B>().size());
+
+    world.collect_unused_entities();
+    auto reused = world.make_entity();
+    EXPECT_EQ(two::entity_index(entity), two::entity_index(reused));
+    EXPECT_FALSE((world.contains<A>(reused)));
+    EXPECT_FALSE((world.contains<B>(reused)));
+    EXPECT_FALSE((world.contains<MoveOnly>(reused)));
+    EXPECT_EQ(0, world.view<B>().size());
+}
+
+TEST(ECS_World, CommandsAfterMove) {
+    two::World moved;
+    auto entity = moved.make_entity();
+    moved.commands().pack(entity, A{1});
+
+    two::World world(std::move(moved));
+    auto created = world.commands().make_entity();
+    world.commands().pack(created, A{2});
+    world.playback_commands();
+    EXPECT_EQ(1, world.unpack<A>(entity).data);
+    EXPECT_TRUE(world.contains<two::Active>(created));
+    EXPECT_EQ(2, world.unpack<A>(created).data);
+    EXPECT_EQ(2, world.view<A>().size());
+}
+
+TEST(ECS_World, ParEachCommands) {
+    two::World world;
+    two::ThreadPool pool(4);
+    world.set_thread_pool(&pool);
+    for (int i = 0; i < 10000; ++i) {
+        world.pack(world.make_entity(), A{i});
+    }
+    world.par_each<A>([&](two::Entity entity, const A &a) {
+        auto &commands = world.commands();
+        if (a.data % 2 == 0) {
+            commands.destroy_entity(entity);
+            return;
+        }
+        auto spawned = commands.make_entity();
+        commands.pack(spawned, B{a.data});
+        commands.pack(entity, B{a.data});
+    });
+    EXPECT_EQ(0, world.view<B>().size());
+    world.playback_commands();
+
+    EXPECT_EQ(5000, world.view<A>().size());
+    EXPECT_EQ(10000, world.view<B>().size());
+    EXPECT_EQ(5000, (world.view<A, B>().size()));
+    world.each<B>([&](two::Entity entity, const B &b) {
+        EXPECT_EQ(1, b.data % 2);
+        if (world.contains<A>(entity)) {
+            EXPECT_EQ(world.unpack<A>(entity).data, b.data);
+        }
+    });
+
+    // Destroyed ids are reused by the next reserved entities
+    world.collect_unused_entities();
+    auto entity = world.commands().make_entity();
+    world.playback_commands();
+    EXPECT_EQ(1, two::entity_version(entity));
+    EXPECT_TRUE(world.contains<two::Active>(entity));
+    EXPECT_FALSE(world.contains<A>(entity));
+}
+
+TEST(ECS_World, ReserveEntity) {
+    two::World world;
+    auto reserved = world.reserve_entity();
+    EXPECT_NE(two::NullEntity, reserved);
+    EXPECT_EQ(reserved, world.make_entity() - 1);
+    EXPECT_EQ(3, world.unsafe_view_all().size());
+
+    std::vector<two::Entity> destroyed;
+    for (int i = 0; i < 100; ++i) {
+        auto entity = world.make_entity();
+        if (i % 2 == 0) destroyed.push_back(entity);
+    }
+    for (auto entity : destroyed) {
+        world.destroy_entity(entity);
+    }
+    world.collect_unused_entities();
+
+    // Ids are taken from the unused entities first, then new indices
+    two::ThreadPool pool(4);
+    std::vector<two::Entity> entities(1000);
+    pool.run(entities.size(), [&](size_t i) {
+        entities[i] = world.reserve_entity();
+    });
+    std::sort(entities.begin(), entities.end());
+    EXPECT_EQ(entities.end(), std::unique(entities.begin(), entities.end()));
+    EXPECT_EQ(50, std::count_if(entities.begin(), entities.end(),
+        [](two::Entity entity) { return two::entity_version(entity) == 1; }));
+
+    world.playback_commands();
+    EXPECT_EQ(1053, world.unsafe_view_all().size());
+    for (auto entity : entities) {
+        EXPECT_NE(two::NullEntity, entity);
+        EXPECT_FALSE(world.contains<two::Active>(entity));
+        world.pack(entity, A{1});
+    }
+    EXPECT_EQ(1000, world.view<A>(true).size());
+
+    // New entities do not reuse reserved ids
+    world.reserve_entity();
+    auto entity = world.make_entity();
+    EXPECT_EQ(std::find(entities.begin(), entities.end(), entity),
+              entities.end());
+    EXPECT_EQ(1055, world.unsafe_view_all().size());
+}
+
+TEST(ECS_World, ReservedEntityMask) {
+    two::World world;
+    world.pack(world.make_entity(), A{1});
+    // Reserved ids past the first page have no mask until played back
+    std::vector<two::Entity> reserved(5000);
+    for (auto &entity : reserved) {
+        entity = world.reserve_entity();
+    }
+    for (auto entity : reserved) {
+        EXPECT_FALSE(world.contains<A>(entity));
+        EXPECT_FALSE(world.contains<two::Active>(entity));
+    }
+    world.playback_commands();
+    world.pack(reserved.back(), A{2});
+    EXPECT_TRUE(world.contains<A>(reserved.back()));
+    EXPECT_FALSE(world.contains<A>(reserved.front()));
+}
+
+TEST(ECS_World, ViewEachCallable) {
+    two::World world;
+    world.pack(world.make_entity(), A{1});
+    world.pack(world.make_entity(), A{2});
+
+    // Functions are taken by reference so state is kept in the caller
+    SumA fn;
+    world.each<A>(fn);
+    EXPECT_EQ(3, fn.sum);
+
+    int count = 0;
+    auto counter = [&count](two::Entity entity, const A &) {
+        EXPECT_NE(entity, two::NullEntity);
+        ++count;
+    };
+    world.each<A>(counter);
+    EXPECT_EQ(2, count);
+}
+
+TEST(ECS_World, ViewEachPacked) {
+    two::World world;
+    std::vector<two::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        auto entity = world.make_entity();
+        world.pack(entity, A{i}, B{i});
+        if (i % 2 == 0)
+            world.pack(entity, C{i});
+        entities.push_back(entity);
+    }
+
+    // C drives the iteration since all entities with C have A and B
+    int count = 0;
+    world.each<A, B, C>([&](two::Entity entity, A &a, B &b, C &c) {
+        EXPECT_EQ(a.data, b.data);
+        EXPECT_EQ(a.data, c.data);
+        EXPECT_EQ(entities[a.data], entity);
+        ++count;
+    });
+    EXPECT_EQ(4, count);
+
+    // Inactive entities are skipped even though they own an A
+    world.set_active(entities[1], false);
+    count = 0;
+    world.each<A>([&](two::Entity entity, A &) {
+        EXPECT_NE(entities[1], entity);
+        ++count;
+    });
+    EXPECT_EQ(7, count);
+    world.set_active(entities[1], true);
+
+    // Destroying the current entity does not skip other entities
+    count = 0;
+    world.each<A>([&](two::Entity entity, A &a) {
+        if (a.data % 2 == 1)
+            world.destroy_entity(entity);
+        ++count;
+    });
+    EXPECT_EQ(8, count);
+    EXPECT_EQ(4, world.view<A>().size());
+}
+
+TEST(ECS_World, PersistentView) {
+    two::World world;
+    auto view = world.make_view<A, B>();
+    EXPECT_EQ(0, view.size());
+
+    auto e0 = world.make_entity();
+    auto e1 = world.make_entity();
+    world.pack(e0, A{1}, B{2});
+    world.pack(e1, A{3});
+
+    // Changes made after the view was created are visible
+    ASSERT_EQ(1, view.size());
+    EXPECT_EQ(e0, *view.begin());
+    EXPECT_EQ(1, view.unpack<A>(e0).data);
+    EXPECT_EQ(2, view.unpack<B>(e0).data);
+
+    world.pack(e1, B{4});
+    int sum = 0;
+    view.each([&sum](A &a, B &b) { sum += a.data + b.data; });
+    EXPECT_EQ(10, sum);
+
+    world.set_active(e0, false);
+    view.each([e1](two::Entity entity, A &, B &) {
+        EXPECT_EQ(e1, entity);
+    });
+    EXPECT_EQ(2, (world.make_view<A, B>(true).size()));
 }
 
 TEST(ECS_World, MakeSystem) {
@@ -150,6 +1281,94 @@ TEST(ECS_World, MakeSystem) {
     EXPECT_EQ(2, world.systems().size());
 }
 
+// Systems used to test `schedule_systems`
+class IncrementA : public two::System {
+public:
+    two::SystemAccess access() const override {
+        return two::SystemAccess().write<A>();
+    }
+    void update(two::World *world, float) override {
+        world->each<A>([](A &a) { ++a.data; });
+    }
+};
+
+class CopyAToB : public two::System {
+public:
+    two::SystemAccess access() const override {
+        return two::SystemAccess().read<A>().write<B>();
+    }
+    void update(two::World *world, float) override {
+        world->each<A, B>([](const A &a, B &b) { b.data = a.data; });
+    }
+};
+
+class IncrementC : public two::System {
+public:
+    two::SystemAccess access() const override {
+        return two::SystemAccess().write<C>();
+    }
+    void update(two::World *world, float) override {
+        world->each<C>([](C &c) { ++c.data; });
+    }
+};
+
+class Spawner : public two::System {
+public:
+    void update(two::World *world, float) override {
+        world->pack(world->make_entity(), A{0}, B{0}, C{0});
+    }
+};
+
+TEST(ECS_World, ScheduleSystems) {
+    EXPECT_FALSE(two::SystemAccess().write<A>().conflicts(
+        two::SystemAccess().read<B>().write<C>()));
+    EXPECT_FALSE(two::SystemAccess().read<A>().conflicts(
+        two::SystemAccess().read<A>()));
+    EXPECT_TRUE(two::SystemAccess().read<A>().conflicts(
+        two::SystemAccess().write<A>()));
+    EXPECT_TRUE(two::SystemAccess().conflicts(two::SystemAccess(true)));
+
+    for (int lag = 0; lag < 2; ++lag) {
+        two::World world;
+        two::ThreadPool pool(4);
+        world.set_thread_pool(&pool);
+        world.make_system<Spawner>();
+        if (lag) {
+            // B is copied before A is incremented
+            world.make_system<CopyAToB>();
+            world.make_system<IncrementA>();
+        } else {
+            world.make_system<IncrementA>();
+            world.make_system<CopyAToB>();
+        }
+        world.make_system<IncrementC>();
+
+        for (int i = 0; i < 10; ++i) {
+            pool.wait(world.schedule_systems(1.0f));
+        }
+        EXPECT_EQ(10, world.view<A>().size());
+        world.each<A, B, C>([lag](const A &a, const B &b, const C &c) {
+            EXPECT_EQ(a.data, c.data);
+            EXPECT_EQ(a.data - lag, b.data);
+        });
+        world.destroy_systems();
+    }
+}
+
+TEST(ECS_World, ScheduleSystemsStructuralChanges) {
+    class Declared : public Spawner {
+        two::SystemAccess access() const override {
+            return two::SystemAccess().write<A>();
+        }
+    };
+    two::World world;
+    two::ThreadPool pool(1);
+    world.set_thread_pool(&pool);
+    world.make_system<Declared>();
+    EXPECT_DEBUG_DEATH(pool.wait(world.schedule_systems(1.0f)), "");
+    world.destroy_systems();
+}
+
 TEST(ECS_World, Events) {
     two::World world;
     int res = 0;
@@ -174,3 +1393,114 @@ TEST(ECS_World, Events) {
     world.emit(A{});
     EXPECT_EQ(12, res);
 }
+
+struct Counter {
+    int count = 0;
+    bool add(const int &n) { count += n; return true; }
+};
+
+struct IsOwned {
+    std::unique_ptr<int> owned;
+    bool operator()(const int &n) const { return *owned == n; }
+};
+
+TEST(ECS_Delegate, Callables) {
+    using Handler = two::Delegate<bool (const int &)>;
+    Handler empty;
+    EXPECT_FALSE(empty);
+
+    int sum = 0;
+    Handler small([&sum](const int &n) { sum += n; return true; });
+    EXPECT_TRUE(small(2));
+    EXPECT_EQ(2, sum);
+
+    // Stored on the heap
+    int big[16] = {};
+    Handler large([big, &sum](const int &n) {
+        sum += n + big[15];
+        return false;
+    });
+    EXPECT_FALSE(large(3));
+    EXPECT_EQ(5, sum);
+
+    Handler move_only(IsOwned{std::unique_ptr<int>(new int(10))});
+    EXPECT_TRUE(move_only(10));
+
+    Counter counter;
+    Handler member(&Counter::add, &counter);
+    member(4);
+    EXPECT_EQ(4, counter.count);
+
+    bool (*fn)(const int &) = [](const int &n) { return n > 0; };
+    Handler pointer(fn);
+    EXPECT_TRUE(pointer(1));
+
+    // Moving keeps the callable
+    std::vector<Handler> handlers;
+    handlers.emplace_back(std::move(small));
+    handlers.emplace_back(std::move(large));
+    handlers.emplace_back(std::move(move_only));
+    handlers.emplace_back(std::move(member));
+    EXPECT_FALSE(small);
+    handlers.resize(64);
+    EXPECT_TRUE(handlers[0](1));
+    EXPECT_FALSE(handlers[1](1));
+    EXPECT_TRUE(handlers[2](10));
+    EXPECT_TRUE(handlers[3](1));
+    EXPECT_EQ(7, sum);
+    EXPECT_EQ(5, counter.count);
+
+    handlers[0] = std::move(handlers[3]);
+    handlers[0](1);
+    EXPECT_EQ(6, counter.count);
+}
+
+TEST(ECS_World, EventQueue) {
+    two::World world;
+    two::ThreadPool pool(4);
+    world.set_thread_pool(&pool);
+
+    // Not queued since there are no handlers
+    world.enqueue(A{1});
+
+    std::vector<int> odd;
+    std::vector<int> unhandled;
+    world.bind<A>([&odd](const A &event) {
+        if (event.data % 2 == 0) return false;
+        odd.push_back(event.data);
+        return true;
+    });
+    world.bind_batch<A>([&unhandled](size_t count, const A *events) {
+        for (size_t i = 0; i < count; ++i) {
+            unhandled.push_back(events[i].data);
+        }
+    });
+    world.bind<B>([&world](const B &event) {
+        // Delivered on the next dispatch
+        world.enqueue(A{event.data});
+        return true;
+    });
+
+    pool.run(100, [&world](size_t i) {
+        world.enqueue(A{int(i)});
+    });
+    world.enqueue(B{101});
+    EXPECT_TRUE(odd.empty());
+
+    world.dispatch_events();
+    std::sort(odd.begin(), odd.end());
+    std::sort(unhandled.begin(), unhandled.end());
+    ASSERT_EQ(50, odd.size());
+    ASSERT_EQ(50, unhandled.size());
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(2 * i + 1, odd[i]);
+        EXPECT_EQ(2 * i, unhandled[i]);
+    }
+
+    world.dispatch_events();
+    EXPECT_EQ(51, odd.size());
+    EXPECT_EQ(101, odd.back());
+    world.dispatch_events();
+    EXPECT_EQ(51, odd.size());
+    EXPECT_EQ(50, unhandled.size());
+}